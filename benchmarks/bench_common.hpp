@@ -0,0 +1,174 @@
+#ifndef UNET_BENCH_COMMON_HPP
+#define UNET_BENCH_COMMON_HPP
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace unet::bench
+{
+    using bench_clock = std::chrono::steady_clock;
+
+    inline uint64_t elapsed_ns(bench_clock::time_point start, bench_clock::time_point end = bench_clock::now()) noexcept
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+    }
+
+    // Log-linear latency histogram; every power of two is split into
+    // `sub_buckets` linear buckets, so recorded values are accurate to
+    // within 1 / sub_buckets of their magnitude.
+    class latency_histogram
+    {
+        public:
+            constexpr static size_t sub_bucket_bits = 4;
+            constexpr static size_t sub_buckets     = 1 << sub_bucket_bits;
+
+            void record(uint64_t value) noexcept
+            {
+                buckets[bucket_index(value)]++;
+                total++;
+                sum += value;
+                min_value = std::min(min_value, value);
+                max_value = std::max(max_value, value);
+            }
+
+            uint64_t percentile(double p) const noexcept
+            {
+                if (total == 0)
+                    return 0;
+
+                const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(p / 100.0 * total + 0.5));
+                uint64_t seen = 0;
+                for (size_t i = 0; i < buckets.size(); ++i)
+                {
+                    seen += buckets[i];
+                    if (seen >= rank)
+                        return std::clamp(bucket_value(i), min_value, max_value);
+                }
+                return max_value;
+            }
+
+            void merge(const latency_histogram& other) noexcept
+            {
+                for (size_t i = 0; i < buckets.size(); ++i)
+                    buckets[i] += other.buckets[i];
+                total += other.total;
+                sum += other.sum;
+                min_value = std::min(min_value, other.min_value);
+                max_value = std::max(max_value, other.max_value);
+            }
+
+            uint64_t count() const noexcept { return total; }
+            uint64_t min() const noexcept { return total ? min_value : 0; }
+            uint64_t max() const noexcept { return max_value; }
+            double mean() const noexcept { return total ? double(sum) / double(total) : 0.0; }
+
+        private:
+            static size_t bucket_index(uint64_t value) noexcept
+            {
+                if (value < sub_buckets)
+                    return value;
+
+                const size_t magnitude = std::bit_width(value) - 1;
+                const size_t shift = magnitude - sub_bucket_bits;
+                const size_t sub = (value >> shift) & (sub_buckets - 1);
+                return (shift + 1) * sub_buckets + sub;
+            }
+
+            // midpoint of the bucket
+            static uint64_t bucket_value(size_t index) noexcept
+            {
+                if (index < sub_buckets)
+                    return index;
+
+                const size_t shift = index / sub_buckets - 1;
+                const uint64_t base = (uint64_t(sub_buckets) | (index & (sub_buckets - 1))) << shift;
+                return base + ((uint64_t(1) << shift) >> 1);
+            }
+
+            std::array<uint64_t, (64 - sub_bucket_bits + 1) * sub_buckets> buckets{};
+            uint64_t total = 0;
+            uint64_t sum = 0;
+            uint64_t min_value = UINT64_MAX;
+            uint64_t max_value = 0;
+    };
+
+    // Minimal JSON writer, only what the benchmark reports need.
+    class json_object
+    {
+        public:
+            json_object& add(const std::string& key, const std::string& value)
+            {
+                std::string escaped;
+                for (char c : value) {
+                    if (c == '"' || c == '\\')
+                        escaped += '\\';
+                    escaped += c;
+                }
+                return add_raw(key, "\"" + escaped + "\"");
+            }
+
+            json_object& add(const std::string& key, const char* value) { return add(key, std::string(value)); }
+
+            template <typename T> requires std::is_arithmetic_v<T>
+            json_object& add(const std::string& key, T value)
+            {
+                if constexpr (std::is_floating_point_v<T>) {
+                    char buffer[64];
+                    std::snprintf(buffer, sizeof(buffer), "%.6g", double(value));
+                    return add_raw(key, buffer);
+                } else {
+                    return add_raw(key, std::to_string(value));
+                }
+            }
+
+            json_object& add(const std::string& key, const json_object& value) { return add_raw(key, value.str()); }
+
+            json_object& add(const std::string& key, const std::vector<json_object>& values)
+            {
+                std::string array = "[";
+                for (size_t i = 0; i < values.size(); ++i)
+                    array += (i ? ", " : "") + values[i].str();
+                return add_raw(key, array + "]");
+            }
+
+            std::string str() const
+            {
+                std::string rval = "{";
+                for (size_t i = 0; i < fields.size(); ++i)
+                    rval += (i ? ", \"" : "\"") + fields[i].first + "\": " + fields[i].second;
+                return rval + "}";
+            }
+
+        private:
+            json_object& add_raw(const std::string& key, std::string value)
+            {
+                fields.emplace_back(key, std::move(value));
+                return *this;
+            }
+
+            std::vector<std::pair<std::string, std::string>> fields;
+    };
+
+    inline json_object to_json(const latency_histogram& hist)
+    {
+        json_object rval;
+        rval.add("count", hist.count())
+            .add("min_ns", hist.min())
+            .add("mean_ns", hist.mean())
+            .add("p50_ns", hist.percentile(50.0))
+            .add("p99_ns", hist.percentile(99.0))
+            .add("p999_ns", hist.percentile(99.9))
+            .add("max_ns", hist.max());
+        return rval;
+    }
+}
+
+#endif
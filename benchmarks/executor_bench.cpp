@@ -0,0 +1,213 @@
+// Scaling of basic_executor from 1 to N worker threads on a mixed-cost
+// echo workload: most requests are cheap, every `expensive_every`th one
+// spins for much longer, so a single reactor stalls everything behind it.
+//
+// Build (from the repository root):
+//   g++ -std=c++20 -O2 -DUNET_EPOLL -Iinclude benchmarks/executor_bench.cpp -o executor_bench -pthread -ldl
+//
+// Usage:
+//   executor_bench [--quick] [--port N] [--max-threads N] [--label STR] [--out FILE]
+
+#include <micronet/tcp.hpp>
+#include <micronet/executor.hpp>
+
+#include "bench_common.hpp"
+#include "syscall_counter.hpp"
+
+#include <atomic>
+#include <fstream>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+using namespace unet::bench;
+
+namespace
+{
+    struct options
+    {
+        bool quick = false;
+        uint16_t port = 19100;
+        size_t max_threads = std::max(1u, std::thread::hardware_concurrency());
+        std::string label;
+        std::string output;
+    };
+
+    constexpr const char* loopback = "127.0.0.1";
+
+    constexpr size_t client_threads = 4;
+    constexpr size_t connections_per_client = 16;
+    constexpr size_t expensive_every = 16;
+
+    constexpr auto cheap_cost = std::chrono::microseconds(2);
+    constexpr auto expensive_cost = std::chrono::microseconds(200);
+
+    using message = std::array<char, 16>;
+
+    void spin_for(std::chrono::nanoseconds duration)
+    {
+        const auto until = bench_clock::now() + duration;
+        while (bench_clock::now() < until)
+            ;
+    }
+
+    bool echo_handler(unet::tcp_connection& conn)
+    {
+        auto msg = conn.recv<message>();
+        if (not msg.has_value())
+            return false;
+
+        spin_for(msg.value()[0] ? expensive_cost : cheap_cost);
+        return conn.send(std::span<const char>(msg.value())).has_value();
+    }
+
+    json_object bench_threads(const options& opts, uint16_t port, size_t threads)
+    {
+        const auto duration = opts.quick ? std::chrono::milliseconds(500) : std::chrono::milliseconds(3000);
+        const size_t total_connections = client_threads * connections_per_client;
+
+        unet::basic_executor<unet::tcp_connection> executor;
+        if (auto res = executor.start({ .threads = threads }); not res.has_value())
+            return json_object{}.add("error", unet::explain(res.error()));
+
+        unet::tcp_connection listener;
+        if (auto res = listener.listen(port, 256); not res.has_value())
+            return json_object{}.add("error", unet::explain(res.error()));
+
+        std::thread acceptor([&] {
+            for (size_t i = 0; i < total_connections; ++i) {
+                auto conn = listener.accept();
+                if (conn.has_value())
+                    executor.add(std::move(conn.value()), echo_handler);
+            }
+        });
+
+        std::vector<std::vector<unet::tcp_connection>> clients(client_threads);
+        for (auto& conns : clients) {
+            conns.resize(connections_per_client);
+            for (auto& conn : conns)
+                conn.connect(loopback, port);
+        }
+        acceptor.join();
+
+        std::atomic<bool> done = false;
+        std::vector<latency_histogram> histograms(client_threads);
+        std::vector<size_t> requests(client_threads, 0);
+        std::vector<std::thread> client_workers;
+
+        const auto start = bench_clock::now();
+        for (size_t c = 0; c < client_threads; ++c) {
+            client_workers.emplace_back([&, c] {
+                std::vector<bench_clock::time_point> sent_at(connections_per_client);
+                size_t sequence = c;
+
+                // keep one request in flight per connection
+                while (not done.load(std::memory_order_relaxed)) {
+                    for (size_t i = 0; i < connections_per_client; ++i) {
+                        message msg{};
+                        msg[0] = (sequence++ % expensive_every) == 0;
+                        sent_at[i] = bench_clock::now();
+                        clients[c][i].send(std::span<const char>(msg));
+                    }
+                    for (size_t i = 0; i < connections_per_client; ++i) {
+                        if (not clients[c][i].recv<message>().has_value())
+                            return;
+                        histograms[c].record(elapsed_ns(sent_at[i]));
+                        requests[c]++;
+                    }
+                }
+            });
+        }
+
+        std::this_thread::sleep_for(duration);
+        done.store(true);
+        for (auto& t : client_workers)
+            t.join();
+        const double seconds = elapsed_ns(start) / 1e9;
+
+        const unet::executor_stats stats = executor.stats();
+        clients.clear();
+        executor.stop();
+
+        latency_histogram hist;
+        size_t total_requests = 0;
+        for (size_t c = 0; c < client_threads; ++c) {
+            total_requests += requests[c];
+            hist.merge(histograms[c]);
+        }
+
+        json_object rval;
+        rval.add("threads", threads)
+            .add("connections", total_connections)
+            .add("requests", total_requests)
+            .add("seconds", seconds)
+            .add("requests_per_second", total_requests / seconds)
+            .add("tasks_run", stats.tasks_run)
+            .add("tasks_stolen", stats.tasks_stolen)
+            .add("parks", stats.parks)
+            .add("latency", to_json(hist));
+        return rval;
+    }
+
+    bool parse_options(int argc, char** argv, options& opts)
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            const std::string arg = argv[i];
+            const bool has_value = i + 1 < argc;
+
+            if (arg == "--quick")
+                opts.quick = true;
+            else if (arg == "--port" && has_value)
+                opts.port = static_cast<uint16_t>(std::stoi(argv[++i]));
+            else if (arg == "--max-threads" && has_value)
+                opts.max_threads = std::max(1, std::stoi(argv[++i]));
+            else if (arg == "--label" && has_value)
+                opts.label = argv[++i];
+            else if (arg == "--out" && has_value)
+                opts.output = argv[++i];
+            else {
+                std::cerr << "usage: " << argv[0] << " [--quick] [--port N] [--max-threads N] [--label STR] [--out FILE]\n";
+                return false;
+            }
+        }
+        return true;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    options opts;
+    if (not parse_options(argc, argv, opts))
+        return -1;
+
+    std::vector<json_object> results;
+    uint16_t port = opts.port;
+
+    for (size_t threads = 1; ; threads *= 2) {
+        threads = std::min(threads, opts.max_threads);
+        std::cerr << "running executor with " << threads << " threads...\n";
+
+        const syscall_counts before = syscall_snapshot();
+        json_object result = bench_threads(opts, port++, threads);
+        result.add("syscalls", to_json(syscall_snapshot() - before));
+        results.push_back(result);
+
+        if (threads == opts.max_threads)
+            break;
+    }
+
+    json_object report;
+    report.add("benchmark", "executor_scaling")
+          .add("label", opts.label)
+          .add("quick", int(opts.quick))
+          .add("hardware_threads", std::thread::hardware_concurrency())
+          .add("results", results);
+
+    if (opts.output.empty()) {
+        std::cout << report.str() << "\n";
+    } else {
+        std::ofstream out(opts.output);
+        out << report.str() << "\n";
+    }
+}
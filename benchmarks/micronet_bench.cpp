@@ -0,0 +1,1029 @@
+// Loopback benchmarks for the micronet I/O paths.
+//
+// Build (from the repository root):
+//   g++ -std=c++20 -O2 -DUNET_EPOLL -Iinclude benchmarks/micronet_bench.cpp -o micronet_bench -pthread -ldl
+//
+// Usage:
+//   micronet_bench [--quick] [--port N] [--label STR] [--out FILE]
+//
+// Results are written as a single JSON document (to stdout unless --out is
+// given) so runs can be compared across commits; a short human readable
+// summary goes to stderr.
+
+#include <micronet/tcp.hpp>
+#include <micronet/udp.hpp>
+#include <micronet/http.hpp>
+#include <micronet/connection_pool.hpp>
+#include <micronet/capture.hpp>
+
+#include "bench_common.hpp"
+#include "syscall_counter.hpp"
+
+#include <atomic>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <numeric>
+#include <thread>
+#include <vector>
+
+using namespace unet::bench;
+
+namespace
+{
+    struct options
+    {
+        bool quick = false;
+        uint16_t port = 19000;
+        std::string label;
+        std::string output;
+    };
+
+    constexpr const char* loopback = "127.0.0.1";
+
+    // Runs `fn`, tagging its result with the syscalls made while it ran.
+    template <typename Fn>
+    json_object measure(const std::string& name, Fn&& fn)
+    {
+        std::cerr << "running " << name << "...\n";
+
+        const syscall_counts before = syscall_snapshot();
+        json_object rval = fn();
+        const syscall_counts after = syscall_snapshot();
+
+        json_object tagged;
+        tagged.add("name", name)
+              .add("results", rval)
+              .add("syscalls", to_json(after - before));
+        return tagged;
+    }
+
+    bool listen_or_report(unet::tcp_socket& listener, uint16_t port)
+    {
+        auto res = listener.listen(port, 128);
+        if (not res.has_value())
+            std::cerr << "listen on " << port << ": " << unet::explain(res.error()) << "\n";
+        return res.has_value();
+    }
+
+    // with `busy_poll` both ends spin instead of sleeping in recv(); the
+    // client is a `Client`, to measure what its socket type adds
+    template <typename Client = unet::tcp_socket>
+    json_object bench_echo_latency(const options& opts, uint16_t port, bool busy_poll)
+    {
+        constexpr static size_t message_size = 64;
+        using message = std::array<char, message_size>;
+
+        const size_t warmup = 1000;
+        const size_t iterations = opts.quick ? 10000 : 100000;
+
+        unet::tcp_socket listener;
+        if (not listen_or_report(listener, port))
+            return json_object{}.add("error", "listen");
+
+        std::thread server([&] {
+            auto conn = listener.accept();
+            if (not conn.has_value())
+                return;
+            if (busy_poll)
+                conn->enable_busy_poll();
+
+            while (true) {
+                auto msg = conn->recv<message>();
+                if (not msg.has_value())
+                    break;
+                conn->send(std::span<const char>(msg.value()));
+            }
+        });
+
+        latency_histogram hist;
+        {
+            Client client;
+            if (client.connect(loopback, port).has_value())
+            {
+                if (busy_poll)
+                    client.enable_busy_poll();
+
+                message msg{};
+                for (size_t i = 0; i < warmup + iterations; ++i)
+                {
+                    const auto start = bench_clock::now();
+                    client.send(std::span<const char>(msg));
+                    auto reply = client.template recv<message>();
+                    const uint64_t ns = elapsed_ns(start);
+
+                    if (not reply.has_value())
+                        break;
+                    if (i >= warmup)
+                        hist.record(ns);
+                }
+            }
+        }
+        server.join();
+
+        json_object rval = to_json(hist);
+        rval.add("message_bytes", message_size)
+            .add("busy_poll", int(busy_poll));
+        return rval;
+    }
+
+    json_object bench_bulk_throughput(const options& opts, uint16_t port)
+    {
+        constexpr static size_t chunk_size = 64 * 1024;
+        const size_t total_bytes = (opts.quick ? 64ull : 512ull) * 1024 * 1024;
+
+        unet::tcp_socket listener;
+        if (not listen_or_report(listener, port))
+            return json_object{}.add("error", "listen");
+
+        size_t received = 0;
+        size_t recv_calls = 0;
+        std::thread server([&] {
+            auto conn = listener.accept();
+            if (not conn.has_value())
+                return;
+
+            while (received < total_bytes) {
+                auto data = conn->recv_all<std::vector<char>>();
+                if (not data.has_value())
+                    break;
+                received += data->size();
+                recv_calls++;
+            }
+        });
+
+        const auto start = bench_clock::now();
+        {
+            unet::tcp_socket client;
+            if (client.connect(loopback, port).has_value())
+            {
+                std::vector<char> chunk(chunk_size, 'x');
+                for (size_t sent = 0; sent < total_bytes; sent += chunk_size)
+                    client.send(std::span<const char>(chunk));
+            }
+            server.join();
+        }
+        const double seconds = elapsed_ns(start) / 1e9;
+
+        json_object rval;
+        rval.add("bytes", received)
+            .add("seconds", seconds)
+            .add("mib_per_second", received / seconds / (1024.0 * 1024.0))
+            .add("recv_all_calls", recv_calls)
+            .add("send_chunk_bytes", chunk_size);
+        return rval;
+    }
+
+    struct wire_sample
+    {
+        uint32_t id;
+        uint16_t port;
+        uint16_t flags;
+        double value;
+
+        constexpr static auto wire_layout = unet::wire_fields<4, 2, 2, 8>;
+    };
+
+    // send_array/recv_array, byte order conversion included on both ends
+    template <typename T>
+    json_object bench_typed_array(const options& opts, uint16_t port)
+    {
+        constexpr static size_t elements_per_send = 64 * 1024 / sizeof(T);
+        const size_t total_bytes = (opts.quick ? 64ull : 512ull) * 1024 * 1024;
+        const size_t rounds = total_bytes / (elements_per_send * sizeof(T));
+
+        unet::tcp_socket listener;
+        if (not listen_or_report(listener, port))
+            return json_object{}.add("error", "listen");
+
+        size_t received = 0;
+        std::thread server([&] {
+            auto conn = listener.accept();
+            if (not conn.has_value())
+                return;
+
+            std::vector<T> output(elements_per_send);
+            for (size_t i = 0; i < rounds; ++i) {
+                if (not conn->recv_array(std::span<T>(output)).has_value())
+                    break;
+                received += output.size() * sizeof(T);
+            }
+        });
+
+        const auto start = bench_clock::now();
+        {
+            unet::tcp_socket client;
+            if (client.connect(loopback, port).has_value())
+            {
+                std::vector<T> input(elements_per_send);
+                for (size_t i = 0; i < rounds; ++i)
+                    client.send_array(std::span<const T>(input));
+            }
+            server.join();
+        }
+        const double seconds = elapsed_ns(start) / 1e9;
+
+        json_object rval;
+        rval.add("element_bytes", sizeof(T))
+            .add("bytes", received)
+            .add("seconds", seconds)
+            .add("mib_per_second", received / seconds / (1024.0 * 1024.0));
+        return rval;
+    }
+
+    struct socktype_checked_tcp : unet::socktype_tcp, unet::crc32c_stage {};
+
+    // frames with a CRC32C trailer, summed by the crc32c_stage while the
+    // bytes pass through the socket, or in a separate pass on each end;
+    // frames past the cache size are where the separate pass reads cold data
+    template <typename Socket>
+    json_object bench_checked_frames(const options& opts, uint16_t port, size_t frame_size)
+    {
+        const size_t frames = (opts.quick ? 64 : 512) * 1024 * 1024 / frame_size;
+
+        Socket listener;
+        if (auto res = listener.listen(port, 128); not res.has_value())
+            return json_object{}.add("error", "listen");
+
+        size_t received = 0;
+        size_t mismatches = 0;
+        std::thread server([&] {
+            auto conn = listener.accept();
+            if (not conn.has_value())
+                return;
+
+            std::vector<char> frame(frame_size);
+            for (size_t i = 0; i < frames; ++i) {
+                if constexpr (Socket::is_crc32c_checked) {
+                    auto res = conn->recv_checked(std::span<char>(frame));
+                    if (not res.has_value() && res.error() != unet::error_code::checksum_mismatch)
+                        break;
+                    mismatches += not res.has_value();
+                } else {
+                    uint32_t trailer = 0;
+                    if (not conn->recv_array(std::span<char>(frame)).has_value()
+                        || not conn->recv_array(std::span<uint32_t>(&trailer, 1)).has_value())
+                        break;
+                    mismatches += unet::crc32c(frame) != trailer;
+                }
+                received += frame_size;
+            }
+        });
+
+        const auto start = bench_clock::now();
+        {
+            Socket client;
+            if (client.connect(loopback, port).has_value())
+            {
+                std::vector<char> frame(frame_size, 'x');
+                for (size_t i = 0; i < frames; ++i) {
+                    frame[i % frame_size] = char(i);
+                    if constexpr (Socket::is_crc32c_checked) {
+                        client.send_checked(std::span<const char>(frame));
+                    } else {
+                        const uint32_t trailer = unet::crc32c(frame);
+                        client.send(std::span<const char>(frame));
+                        client.send_array(std::span<const uint32_t>(&trailer, 1));
+                    }
+                }
+            }
+            server.join();
+        }
+        const double seconds = elapsed_ns(start) / 1e9;
+
+        json_object rval;
+        rval.add("frame_bytes", frame_size)
+            .add("bytes", received)
+            .add("mismatches", mismatches)
+            .add("seconds", seconds)
+            .add("mib_per_second", received / seconds / (1024.0 * 1024.0));
+        return rval;
+    }
+
+    // large messages written in small pieces, read as a known size with
+    // recv_array (one MSG_WAITALL receive once it waits) or by looping on recv_some;
+    // the receiving side's syscalls are counted, the sockopt calls included
+    json_object bench_large_messages(const options& opts, uint16_t port, bool known_size)
+    {
+        constexpr static size_t message_size = 256 * 1024;
+        constexpr static size_t piece_size = 4 * 1024;
+        const size_t messages = opts.quick ? 256 : 2048;
+
+        unet::tcp_socket listener;
+        if (not listen_or_report(listener, port))
+            return json_object{}.add("error", "listen");
+
+        size_t received = 0;
+        syscall_counts receiving{};
+        std::thread server([&] {
+            auto conn = listener.accept();
+            if (not conn.has_value())
+                return;
+
+            std::vector<char> message(message_size);
+            auto receive_messages = [&] {
+                for (size_t i = 0; i < messages; ++i) {
+                    if (known_size) {
+                        if (not conn->recv_array(std::span<char>(message)).has_value())
+                            return;
+                    } else {
+                        for (size_t filled = 0; filled < message_size;) {
+                            auto n = conn->recv_some(std::span<char>(message.data() + filled, message_size - filled));
+                            if (not n.has_value())
+                                return;
+                            filled += n.value();
+                        }
+                    }
+                    received += message_size;
+                }
+            };
+
+            // the client only sends, so everything else made meanwhile is ours
+            const syscall_counts before = syscall_snapshot();
+            receive_messages();
+            receiving = syscall_snapshot() - before;
+            receiving[static_cast<size_t>(syscall_id::send)] = 0;
+        });
+
+        const auto start = bench_clock::now();
+        {
+            unet::tcp_socket client;
+            if (client.connect(loopback, port).has_value())
+            {
+                const std::vector<char> piece(piece_size, 'x');
+                for (size_t i = 0; i < messages * message_size / piece_size; ++i)
+                    client.send(std::span<const char>(piece));
+            }
+            server.join();
+        }
+        const double seconds = elapsed_ns(start) / 1e9;
+
+        json_object rval;
+        rval.add("message_bytes", message_size)
+            .add("bytes", received)
+            .add("seconds", seconds)
+            .add("mib_per_second", received / seconds / (1024.0 * 1024.0))
+            .add("receive_syscalls", to_json(receiving))
+            .add("receive_syscalls_per_message", double(std::accumulate(receiving.begin(), receiving.end(), uint64_t(0))) / messages);
+        return rval;
+    }
+
+    // `use_lines` reads with the lines() range instead of recv_append_until
+    json_object bench_recv_until(const options& opts, uint16_t port, size_t line_length, bool use_lines)
+    {
+        const size_t total_bytes = (opts.quick ? 256ull : 4096ull) * 1024;
+        const size_t line_count = total_bytes / line_length;
+
+        unet::tcp_socket listener;
+        if (not listen_or_report(listener, port))
+            return json_object{}.add("error", "listen");
+
+        size_t lines = 0;
+        std::thread server([&] {
+            auto conn = listener.accept();
+            if (not conn.has_value())
+                return;
+
+            if (use_lines) {
+                for (std::string_view line : conn->lines('\n')) {
+                    (void)line;
+                    if (++lines == line_count)
+                        break;
+                }
+                return;
+            }
+
+            std::string line;
+            while (lines < line_count) {
+                auto res = conn->recv_append_until<"\n">(line, { .allow_partial = true });
+                if (not res.has_value())
+                    break;
+                if (not line.empty() && line.back() == '\n') {
+                    lines++;
+                    line.clear();
+                }
+            }
+        });
+
+        const auto start = bench_clock::now();
+        {
+            unet::tcp_socket client;
+            if (client.connect(loopback, port).has_value())
+            {
+                std::string line(line_length - 1, 'x');
+                line += '\n';
+
+                const size_t lines_per_batch = std::max<size_t>(1, 64 * 1024 / line_length);
+                std::string batch;
+                for (size_t i = 0; i < lines_per_batch; ++i)
+                    batch += line;
+
+                for (size_t sent = 0; sent < line_count; sent += lines_per_batch)
+                {
+                    const size_t n = std::min(lines_per_batch, line_count - sent);
+                    client.send(std::span<const char>(batch.data(), n * line_length));
+                }
+            }
+            server.join();
+        }
+        const double seconds = elapsed_ns(start) / 1e9;
+
+        json_object rval;
+        rval.add("line_bytes", line_length)
+            .add("lines", lines)
+            .add("seconds", seconds)
+            .add("lines_per_second", lines / seconds)
+            .add("mib_per_second", lines * line_length / seconds / (1024.0 * 1024.0));
+        return rval;
+    }
+
+    // keep-alive GETs, `depth` pipelined per round trip
+    json_object bench_http_pipelined(const options& opts, uint16_t port, size_t depth)
+    {
+        const size_t requests = opts.quick ? 20000 : 200000;
+        const std::string request = "GET /index.html HTTP/1.1\r\nHost: localhost\r\nUser-Agent: micronet_bench\r\n"
+                                    "Accept: */*\r\nAccept-Encoding: gzip, deflate\r\n\r\n";
+        const std::string response = "HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok";
+
+        unet::tcp_socket listener;
+        if (not listen_or_report(listener, port))
+            return json_object{}.add("error", "listen");
+
+        size_t served = 0;
+        std::thread server([&] {
+            auto conn = listener.accept();
+            if (not conn.has_value())
+                return;
+
+            unet::http::message_reader reader(conn.value());
+            unet::http::request_head head;
+            std::string replies;
+
+            while (served < requests) {
+                if (not reader.read_request(head).has_value())
+                    break;
+                served++;
+
+                // answer a batch once the pipelined requests are used up
+                replies += response;
+                if (reader.buffered().empty()) {
+                    conn->send(replies);
+                    replies.clear();
+                }
+            }
+        });
+
+        const auto start = bench_clock::now();
+        {
+            unet::tcp_socket client;
+            if (client.connect(loopback, port).has_value())
+            {
+                std::string batch;
+                for (size_t i = 0; i < depth; ++i)
+                    batch += request;
+
+                std::vector<char> replies(depth * response.size());
+                for (size_t sent = 0; sent < requests; sent += depth) {
+                    const size_t n = std::min(depth, requests - sent);
+                    client.send(std::span<const char>(batch.data(), n * request.size()));
+
+                    for (size_t got = 0; got < n * response.size();) {
+                        auto r = client.recv_some(std::span<char>(replies.data() + got, n * response.size() - got));
+                        if (not r.has_value())
+                            break;
+                        got += r.value();
+                    }
+                }
+            }
+            server.join();
+        }
+        const double seconds = elapsed_ns(start) / 1e9;
+
+        json_object rval;
+        rval.add("pipeline_depth", depth)
+            .add("requests", served)
+            .add("seconds", seconds)
+            .add("requests_per_second", served / seconds);
+        return rval;
+    }
+
+    struct socktype_concurrent_tcp
+    {
+        constexpr static int    domain          = PF_INET;
+        constexpr static int    type            = SOCK_STREAM;
+        constexpr static bool   secure          = false;
+        constexpr static bool   concurrent_send = true;
+    };
+
+    struct socktype_captured_tcp
+    {
+        constexpr static int    domain          = PF_INET;
+        constexpr static int    type            = SOCK_STREAM;
+        constexpr static bool   secure          = false;
+        constexpr static bool   captured        = true;
+    };
+
+    // echo latency with the client's traffic captured, written to /dev/null
+    json_object bench_echo_captured(const options& opts, uint16_t port)
+    {
+        if (auto res = unet::start_capture({ .path = "/dev/null", .format = unet::capture_format::pcapng }); not res.has_value())
+            return json_object{}.add("error", unet::explain(res.error()));
+
+        json_object rval = bench_echo_latency<unet::basic_socket<socktype_captured_tcp>>(opts, port, false);
+        const unet::capture_stats stats = unet::stop_capture();
+
+        rval.add("captured_records", stats.records)
+            .add("dropped_records", stats.dropped_records);
+        return rval;
+    }
+
+    // several threads sending small messages on one connection, serialised
+    // by a mutex around send() or by the concurrent send queue
+    template <typename Socket>
+    json_object bench_concurrent_send(const options& opts, uint16_t port)
+    {
+        constexpr static size_t message_size = 64;
+        constexpr static size_t producers = 4;
+        const size_t per_producer = opts.quick ? 100'000 : 1'000'000;
+        const size_t total_bytes = producers * per_producer * message_size;
+
+        unet::tcp_connection listener;
+        if (auto res = listener.listen(port, 128); not res.has_value())
+            return json_object{}.add("error", "listen");
+
+        size_t received = 0;
+        std::thread server([&] {
+            auto conn = listener.accept();
+            if (not conn.has_value())
+                return;
+
+            std::vector<char> buffer(64 * 1024);
+            while (received < total_bytes) {
+                auto n = conn->recv_some(std::span<char>(buffer));
+                if (not n.has_value())
+                    break;
+                received += n.value();
+            }
+        });
+
+        const auto start = bench_clock::now();
+        {
+            Socket client;
+            if (client.connect(loopback, port).has_value())
+            {
+                std::mutex send_lock;
+                std::vector<std::thread> threads;
+                for (size_t t = 0; t < producers; ++t) {
+                    threads.emplace_back([&] {
+                        const std::array<char, message_size> message{};
+                        for (size_t i = 0; i < per_producer; ++i) {
+                            if constexpr (Socket::is_concurrent_send) {
+                                client.send(message);
+                            } else {
+                                std::lock_guard guard(send_lock);
+                                client.send(message);
+                            }
+                        }
+                    });
+                }
+                for (std::thread& thread : threads)
+                    thread.join();
+            }
+            server.join();
+        }
+        const double seconds = elapsed_ns(start) / 1e9;
+
+        json_object rval;
+        rval.add("producers", producers)
+            .add("message_bytes", message_size)
+            .add("bytes", received)
+            .add("seconds", seconds)
+            .add("messages_per_second", received / message_size / seconds);
+        return rval;
+    }
+
+    // one small request/response per backend call, over a fresh connection
+    // each time or one from a connection_pool
+    json_object bench_backend_calls(const options& opts, uint16_t port, bool pooled)
+    {
+        const size_t calls = opts.quick ? 2000 : 20000;
+
+        unet::tcp_connection listener;
+        if (auto res = listener.listen(port, 128); not res.has_value())
+            return json_object{}.add("error", "listen");
+
+        // connections are served one after the other until `calls` are answered
+        size_t answered = 0;
+        std::thread server([&] {
+            while (answered < calls) {
+                auto conn = listener.accept();
+                if (not conn.has_value())
+                    continue;
+                while (answered < calls) {
+                    auto request = conn->recv<std::array<char, 64>>();
+                    if (not request.has_value() || not conn->send(request.value()).has_value())
+                        break;
+                    answered++;
+                }
+            }
+        });
+
+        unet::connection_pool<unet::tcp_connection> pool;
+        latency_histogram hist;
+        size_t failed = 0;
+
+        const std::array<char, 64> request{};
+        const auto start = bench_clock::now();
+        for (size_t i = 0; i < calls; ++i)
+        {
+            const auto call_start = bench_clock::now();
+            bool ok = false;
+            if (pooled) {
+                auto conn = pool.acquire(loopback, port);
+                ok = conn && conn.value()->send(request).has_value()
+                          && conn.value()->recv<std::array<char, 64>>().has_value();
+            } else {
+                unet::tcp_connection conn;
+                ok = conn.connect(loopback, port).has_value()
+                     && conn.send(request).has_value()
+                     && conn.recv<std::array<char, 64>>().has_value();
+            }
+
+            if (ok)
+                hist.record(elapsed_ns(call_start));
+            else if (++failed > calls)
+                std::terminate();
+        }
+        const double seconds = elapsed_ns(start) / 1e9;
+        server.join();
+
+        const unet::pool_stats stats = pool.stats();
+        json_object rval = to_json(hist);
+        rval.add("calls", calls)
+            .add("failed", failed)
+            .add("seconds", seconds)
+            .add("calls_per_second", calls / seconds)
+            .add("pool_connects", stats.connects)
+            .add("pool_reuses", stats.reuses);
+        return rval;
+    }
+
+    // connections accepted as sockets, or shed with a RST straight out of
+    // the accept queue as an overloaded server would
+    json_object bench_accept_rate(const options& opts, uint16_t port, bool shed)
+    {
+        const size_t connections = opts.quick ? 2000 : 20000;
+
+        unet::tcp_socket listener;
+        if (not listen_or_report(listener, port))
+            return json_object{}.add("error", "listen");
+
+        size_t accepted = 0;
+        std::thread server([&] {
+            while (accepted < connections) {
+                if (shed) {
+                    // waits for the queue the way a blocking accept() does, no
+                    // back-off; clients connect over IPv4, the listener's native_socket()
+                    unet::detail::os::wait_readable(listener.native_socket(), std::chrono::milliseconds(-1));
+                    accepted += listener.shed_connections().value_or(0);
+                } else if (listener.accept().has_value()) {
+                    accepted++;
+                }
+            }
+        });
+
+        size_t failed = 0;
+        const auto start = bench_clock::now();
+        for (size_t connected = 0; connected < connections;)
+        {
+            unet::tcp_socket client;
+            if (client.connect(loopback, port).has_value())
+                connected++;
+            else if (++failed > connections)
+                std::terminate();
+        }
+        server.join();
+        const double seconds = elapsed_ns(start) / 1e9;
+
+        json_object rval;
+        rval.add("connections", accepted)
+            .add("failed_connects", failed)
+            .add("seconds", seconds)
+            .add("accepts_per_second", accepted / seconds);
+        return rval;
+    }
+
+    json_object bench_udp_datagrams(const options& opts, uint16_t port)
+    {
+        constexpr static size_t datagram_size = 64;
+        using datagram = std::array<char, datagram_size>;
+
+        const size_t datagrams = opts.quick ? 100000 : 1000000;
+
+        unet::udp_socket server_sock;
+        if (auto res = server_sock.open(port); not res.has_value())
+            return json_object{}.add("error", unet::explain(res.error()));
+
+        std::atomic<bool> client_done = false;
+        size_t received = 0;
+        std::thread server([&] {
+            while (received < datagrams) {
+                auto msg = server_sock.recv<datagram>({ .disable_wait = true });
+                if (msg.has_value()) {
+                    received++;
+                } else if (client_done.load(std::memory_order_acquire)) {
+                    // whatever is not in the socket buffer by now was dropped
+                    if (not server_sock.recv<datagram>({ .disable_wait = true }).has_value())
+                        break;
+                    received++;
+                }
+            }
+        });
+
+        size_t sent = 0;
+        const auto start = bench_clock::now();
+        {
+            unet::udp_socket client;
+            if (client.connect(loopback, port).has_value())
+            {
+                datagram msg{};
+                for (; sent < datagrams; ++sent)
+                    if (not client.send(std::span<const char>(msg)).has_value())
+                        break;
+            }
+            client_done.store(true, std::memory_order_release);
+            server.join();
+        }
+        const double seconds = elapsed_ns(start) / 1e9;
+
+        json_object rval;
+        rval.add("datagram_bytes", datagram_size)
+            .add("sent", sent)
+            .add("received", received)
+            .add("seconds", seconds)
+            .add("sent_per_second", sent / seconds)
+            .add("received_per_second", received / seconds);
+        return rval;
+    }
+
+    struct socktype_paced_udp
+    {
+        constexpr static int    domain          = PF_INET;
+        constexpr static int    type            = SOCK_DGRAM;
+        constexpr static bool   secure          = false;
+        constexpr static bool   paced           = true;
+    };
+
+    struct socktype_paced_tcp
+    {
+        constexpr static int    domain          = PF_INET;
+        constexpr static int    type            = SOCK_STREAM;
+        constexpr static bool   secure          = false;
+        constexpr static bool   paced           = true;
+    };
+
+    // what an event loop does with a send the pacer held back: wait for
+    // pacing_timer() and clear it
+    void wait_for_pacing(int timer)
+    {
+        unet::detail::os::wait_readable(timer, std::chrono::milliseconds(-1));
+        uint64_t expirations;
+        (void)::read(timer, &expirations, sizeof(expirations));
+    }
+
+    // datagrams held to a fixed rate by the user-space pacer, how close the
+    // achieved rate gets and what it costs in queueing delay and drops
+    json_object bench_udp_paced(const options& opts, uint16_t port)
+    {
+        constexpr static size_t datagram_size = 1200;
+        using datagram = std::array<char, datagram_size>;
+
+        const uint64_t target_bytes_per_second = 50'000'000;
+        const size_t datagrams = opts.quick ? 20000 : 200000;
+
+        unet::udp_socket server_sock;
+        if (auto res = server_sock.open(port); not res.has_value())
+            return json_object{}.add("error", unet::explain(res.error()));
+
+        std::atomic<bool> client_done = false;
+        size_t received = 0;
+        std::thread server([&] {
+            while (received < datagrams) {
+                auto msg = server_sock.recv<datagram>({ .disable_wait = true });
+                if (msg.has_value()) {
+                    received++;
+                } else if (client_done.load(std::memory_order_acquire)) {
+                    if (not server_sock.recv<datagram>({ .disable_wait = true }).has_value())
+                        break;
+                    received++;
+                }
+            }
+        });
+
+        unet::pacing_stats stats;
+        size_t sent = 0;
+        const auto start = bench_clock::now();
+        {
+            unet::basic_socket<socktype_paced_udp> client;
+            if (client.connect(loopback, port).has_value()
+                && client.enable_pacing({ .bytes_per_second = target_bytes_per_second }).has_value())
+            {
+                const int timer = client.pacing_timer().value_or(-1);
+                datagram msg{};
+                while (sent < datagrams) {
+                    auto res = client.send(std::span<const char>(msg));
+                    if (res.has_value())
+                        sent++;
+                    else if (res.error() == unet::error_code::rate_limited && timer != -1)
+                        wait_for_pacing(timer);
+                    else
+                        break;
+                }
+                stats = client.pacing_info();
+            }
+            client_done.store(true, std::memory_order_release);
+            server.join();
+        }
+        const double seconds = elapsed_ns(start) / 1e9;
+
+        json_object rval;
+        rval.add("datagram_bytes", datagram_size)
+            .add("target_bytes_per_second", target_bytes_per_second)
+            .add("achieved_bytes_per_second", stats.achieved_bytes_per_second)
+            .add("sent", sent)
+            .add("received", received)
+            .add("seconds", seconds)
+            .add("delayed_sends", stats.delayed_sends)
+            .add("mean_delay_ns", stats.delayed_sends ? stats.total_delay_ns / stats.delayed_sends : 0)
+            .add("max_delay_ns", stats.max_delay_ns);
+        return rval;
+    }
+
+    // large stream sends, held to a fixed rate by the user-space pacer or
+    // not, and the most the receiver saw arrive within one millisecond
+    json_object bench_tcp_paced(const options& opts, uint16_t port, bool paced)
+    {
+        constexpr static size_t message_size = 1024 * 1024;
+        const uint64_t target_bytes_per_second = 100'000'000;
+        const size_t messages = opts.quick ? 20 : 100;
+        const size_t total_bytes = messages * message_size;
+
+        unet::tcp_connection listener;
+        if (auto res = listener.listen(port, 128); not res.has_value())
+            return json_object{}.add("error", "listen");
+
+        size_t received = 0;
+        size_t max_bytes_per_ms = 0;
+        std::thread server([&] {
+            auto conn = listener.accept();
+            if (not conn.has_value())
+                return;
+
+            std::vector<char> buffer(256 * 1024);
+            int64_t window = -1;
+            size_t in_window = 0;
+            const auto start = bench_clock::now();
+            while (received < total_bytes) {
+                auto n = conn->recv_some(std::span<char>(buffer));
+                if (not n.has_value())
+                    break;
+                received += n.value();
+
+                const int64_t ms = elapsed_ns(start) / 1'000'000;
+                in_window = ms == window ? in_window + n.value() : n.value();
+                window = ms;
+                max_bytes_per_ms = std::max(max_bytes_per_ms, in_window);
+            }
+        });
+
+        unet::pacing_stats stats;
+        const auto start = bench_clock::now();
+        {
+            unet::basic_socket<socktype_paced_tcp> client;
+            if (client.connect(loopback, port).has_value()
+                && (not paced || client.enable_pacing({ .bytes_per_second = target_bytes_per_second, .use_kernel = false }).has_value()))
+            {
+                const int timer = client.pacing_timer().value_or(-1);
+                const std::vector<char> message(message_size);
+                bool failed = false;
+                for (size_t i = 0; i < messages && not failed; ++i) {
+                    for (size_t sent = 0; sent < message_size;) {
+                        auto res = client.send(std::span<const char>(message.data() + sent, message_size - sent));
+                        if (res.has_value()) {
+                            sent += res.value();
+                        } else if (res.error() != unet::error_code::rate_limited || timer == -1) {
+                            failed = true;
+                            break;
+                        }
+
+                        // refused or short, the pacer armed the timer for the rest
+                        if (sent < message_size)
+                            wait_for_pacing(timer);
+                    }
+                }
+                stats = client.pacing_info();
+            }
+            server.join();
+        }
+        const double seconds = elapsed_ns(start) / 1e9;
+
+        json_object rval;
+        rval.add("message_bytes", message_size)
+            .add("target_bytes_per_second", paced ? target_bytes_per_second : 0)
+            .add("achieved_bytes_per_second", received / seconds)
+            .add("bytes", received)
+            .add("seconds", seconds)
+            .add("max_bytes_per_ms", max_bytes_per_ms)
+            .add("admitted_pieces", stats.sends)
+            .add("delayed_pieces", stats.delayed_sends);
+        return rval;
+    }
+
+    bool parse_options(int argc, char** argv, options& opts)
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            const std::string arg = argv[i];
+            const bool has_value = i + 1 < argc;
+
+            if (arg == "--quick")
+                opts.quick = true;
+            else if (arg == "--port" && has_value)
+                opts.port = static_cast<uint16_t>(std::stoi(argv[++i]));
+            else if (arg == "--label" && has_value)
+                opts.label = argv[++i];
+            else if (arg == "--out" && has_value)
+                opts.output = argv[++i];
+            else {
+                std::cerr << "usage: " << argv[0] << " [--quick] [--port N] [--label STR] [--out FILE]\n";
+                return false;
+            }
+        }
+        return true;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    options opts;
+    if (not parse_options(argc, argv, opts))
+        return -1;
+
+    std::vector<json_object> results;
+    uint16_t port = opts.port;
+
+    results.push_back(measure("echo_latency", [&] { return bench_echo_latency(opts, port++, false); }));
+    results.push_back(measure("echo_latency_busy_poll", [&] { return bench_echo_latency(opts, port++, true); }));
+    results.push_back(measure("echo_latency_captured", [&] { return bench_echo_captured(opts, port++); }));
+    results.push_back(measure("bulk_throughput", [&] { return bench_bulk_throughput(opts, port++); }));
+    results.push_back(measure("array_u32", [&] { return bench_typed_array<uint32_t>(opts, port++); }));
+    results.push_back(measure("array_struct", [&] { return bench_typed_array<wire_sample>(opts, port++); }));
+    for (size_t frame_size : { 64 * 1024, 4 * 1024 * 1024 }) {
+        const std::string suffix = frame_size == 64 * 1024 ? "" : "_4m";
+        results.push_back(measure("checked_frames_separate" + suffix, [&] {
+            return bench_checked_frames<unet::tcp_socket>(opts, port++, frame_size);
+        }));
+        results.push_back(measure("checked_frames_stage" + suffix, [&] {
+            return bench_checked_frames<unet::basic_socket<socktype_checked_tcp>>(opts, port++, frame_size);
+        }));
+    }
+    results.push_back(measure("large_messages_recv_some", [&] { return bench_large_messages(opts, port++, false); }));
+    results.push_back(measure("large_messages_known_size", [&] { return bench_large_messages(opts, port++, true); }));
+    for (size_t line_length : { 16, 64, 256, 1024 })
+        results.push_back(measure("recv_until_" + std::to_string(line_length),
+                                  [&] { return bench_recv_until(opts, port++, line_length, false); }));
+    for (size_t line_length : { 16, 64, 256, 1024 })
+        results.push_back(measure("lines_" + std::to_string(line_length),
+                                  [&] { return bench_recv_until(opts, port++, line_length, true); }));
+    for (size_t depth : { 1, 16 })
+        results.push_back(measure("http_pipelined_" + std::to_string(depth),
+                                  [&] { return bench_http_pipelined(opts, port++, depth); }));
+    results.push_back(measure("concurrent_send_mutex", [&] { return bench_concurrent_send<unet::tcp_connection>(opts, port++); }));
+    results.push_back(measure("concurrent_send_queue", [&] {
+        return bench_concurrent_send<unet::basic_connection<socktype_concurrent_tcp>>(opts, port++);
+    }));
+    results.push_back(measure("backend_calls_fresh", [&] { return bench_backend_calls(opts, port++, false); }));
+    results.push_back(measure("backend_calls_pooled", [&] { return bench_backend_calls(opts, port++, true); }));
+    results.push_back(measure("accept_rate", [&] { return bench_accept_rate(opts, port++, false); }));
+    results.push_back(measure("accept_shed", [&] { return bench_accept_rate(opts, port++, true); }));
+    results.push_back(measure("udp_datagrams", [&] { return bench_udp_datagrams(opts, port++); }));
+    results.push_back(measure("udp_paced", [&] { return bench_udp_paced(opts, port++); }));
+    results.push_back(measure("tcp_unpaced", [&] { return bench_tcp_paced(opts, port++, false); }));
+    results.push_back(measure("tcp_paced", [&] { return bench_tcp_paced(opts, port++, true); }));
+
+    json_object report;
+    report.add("benchmark", "micronet")
+          .add("label", opts.label)
+          .add("quick", int(opts.quick))
+          .add("results", results);
+
+    if (opts.output.empty()) {
+        std::cout << report.str() << "\n";
+    } else {
+        std::ofstream out(opts.output);
+        out << report.str() << "\n";
+    }
+
+    for (const json_object& result : results)
+        std::cerr << result.str() << "\n";
+}
@@ -0,0 +1,262 @@
+// Same-host transports: shm_socket (shared memory rings) next to loopback
+// TCP, for request/response latency, one-way message rate and bulk
+// throughput.  The syscall counts show what the rings save.
+//
+// Build (from the repository root):
+//   g++ -std=c++20 -O2 -DUNET_EPOLL -Iinclude benchmarks/shm_bench.cpp -o shm_bench -pthread -ldl
+//
+// Usage:
+//   shm_bench [--quick] [--port N] [--label STR] [--out FILE]
+
+#include <micronet/tcp.hpp>
+#include <micronet/shm.hpp>
+
+#include "bench_common.hpp"
+#include "syscall_counter.hpp"
+
+#include <fstream>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+using namespace unet::bench;
+
+namespace
+{
+    struct options
+    {
+        bool quick = false;
+        uint16_t port = 19300;
+        std::string label;
+        std::string output;
+    };
+
+    constexpr const char* loopback = "127.0.0.1";
+
+    template <typename Socket>
+    constexpr const char* transport_name() noexcept { return Socket::is_shared_memory ? "shm" : "tcp"; }
+
+    template <typename Socket>
+    json_object bench_echo_latency(const options& opts, uint16_t port)
+    {
+        using message = std::array<char, 64>;
+
+        const size_t warmup = 1000;
+        const size_t iterations = opts.quick ? 10000 : 100000;
+
+        Socket listener;
+        if (auto res = listener.listen(port, 128); not res.has_value())
+            return json_object{}.add("error", unet::explain(res.error()));
+
+        std::thread server([&] {
+            auto conn = listener.accept();
+            if (not conn.has_value())
+                return;
+
+            while (true) {
+                auto msg = conn->template recv<message>();
+                if (not msg.has_value())
+                    break;
+                conn->send(msg.value());
+            }
+        });
+
+        latency_histogram hist;
+        {
+            Socket client;
+            if (client.connect(loopback, port).has_value())
+            {
+                const message msg{};
+                for (size_t i = 0; i < warmup + iterations; ++i)
+                {
+                    const auto start = bench_clock::now();
+                    client.send(msg);
+                    auto reply = client.template recv<message>();
+                    const uint64_t ns = elapsed_ns(start);
+
+                    if (not reply.has_value())
+                        break;
+                    if (i >= warmup)
+                        hist.record(ns);
+                }
+            }
+        }
+        server.join();
+
+        json_object rval = to_json(hist);
+        rval.add("transport", transport_name<Socket>())
+            .add("message_bytes", sizeof(message));
+        return rval;
+    }
+
+    // `message_size` byte messages one way, as fast as the receiver keeps up
+    template <typename Socket>
+    json_object bench_message_rate(const options& opts, uint16_t port, size_t message_size)
+    {
+        const size_t messages = opts.quick ? 1'000'000 : 10'000'000;
+
+        Socket listener;
+        if (auto res = listener.listen(port, 128); not res.has_value())
+            return json_object{}.add("error", unet::explain(res.error()));
+
+        size_t received = 0;
+        std::thread server([&] {
+            auto conn = listener.accept();
+            if (not conn.has_value())
+                return;
+
+            std::vector<char> buffer(message_size);
+            for (; received < messages; ++received) {
+                if (not conn->recv_array(std::span<char>(buffer)).has_value())
+                    break;
+            }
+        });
+
+        const auto start = bench_clock::now();
+        {
+            Socket client;
+            if (client.connect(loopback, port).has_value())
+            {
+                const std::vector<char> message(message_size, 'm');
+                for (size_t i = 0; i < messages; ++i)
+                    client.send(std::span<const char>(message));
+            }
+            server.join();
+        }
+        const double seconds = elapsed_ns(start) / 1e9;
+
+        json_object rval;
+        rval.add("transport", transport_name<Socket>())
+            .add("message_bytes", message_size)
+            .add("messages", received)
+            .add("seconds", seconds)
+            .add("messages_per_second", received / seconds);
+        return rval;
+    }
+
+    template <typename Socket>
+    json_object bench_bulk(const options& opts, uint16_t port)
+    {
+        constexpr static size_t chunk_size = 64 * 1024;
+        const size_t total_bytes = (opts.quick ? 256ull : 2048ull) * 1024 * 1024;
+
+        Socket listener;
+        if (auto res = listener.listen(port, 128); not res.has_value())
+            return json_object{}.add("error", unet::explain(res.error()));
+
+        size_t received = 0;
+        std::thread server([&] {
+            auto conn = listener.accept();
+            if (not conn.has_value())
+                return;
+
+            std::vector<char> buffer(chunk_size);
+            while (received < total_bytes) {
+                auto n = conn->recv_some(std::span<char>(buffer));
+                if (not n.has_value())
+                    break;
+                received += n.value();
+            }
+        });
+
+        const auto start = bench_clock::now();
+        {
+            Socket client;
+            if (client.connect(loopback, port).has_value())
+            {
+                const std::vector<char> chunk(chunk_size, 'x');
+                for (size_t sent = 0; sent < total_bytes; sent += chunk_size)
+                    client.send(std::span<const char>(chunk));
+            }
+            server.join();
+        }
+        const double seconds = elapsed_ns(start) / 1e9;
+
+        json_object rval;
+        rval.add("transport", transport_name<Socket>())
+            .add("bytes", received)
+            .add("seconds", seconds)
+            .add("mib_per_second", received / seconds / (1024.0 * 1024.0));
+        return rval;
+    }
+
+    template <typename Fn>
+    json_object measure(const std::string& name, Fn&& fn)
+    {
+        std::cerr << "running " << name << "...\n";
+
+        const syscall_counts before = syscall_snapshot();
+        json_object rval = fn();
+        const syscall_counts after = syscall_snapshot();
+
+        json_object tagged;
+        tagged.add("name", name)
+              .add("results", rval)
+              .add("syscalls", to_json(after - before));
+        return tagged;
+    }
+
+    bool parse_options(int argc, char** argv, options& opts)
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            const std::string arg = argv[i];
+            const bool has_value = i + 1 < argc;
+
+            if (arg == "--quick")
+                opts.quick = true;
+            else if (arg == "--port" && has_value)
+                opts.port = static_cast<uint16_t>(std::stoi(argv[++i]));
+            else if (arg == "--label" && has_value)
+                opts.label = argv[++i];
+            else if (arg == "--out" && has_value)
+                opts.output = argv[++i];
+            else {
+                std::cerr << "usage: " << argv[0] << " [--quick] [--port N] [--label STR] [--out FILE]\n";
+                return false;
+            }
+        }
+        return true;
+    }
+
+    template <typename Socket>
+    void run_all(const options& opts, uint16_t& port, std::vector<json_object>& results)
+    {
+        const std::string prefix = transport_name<Socket>();
+
+        results.push_back(measure(prefix + "_echo_latency", [&] { return bench_echo_latency<Socket>(opts, port++); }));
+        for (size_t message_size : { 64, 1024 })
+            results.push_back(measure(prefix + "_message_rate_" + std::to_string(message_size),
+                                      [&] { return bench_message_rate<Socket>(opts, port++, message_size); }));
+        results.push_back(measure(prefix + "_bulk", [&] { return bench_bulk<Socket>(opts, port++); }));
+    }
+}
+
+int main(int argc, char** argv)
+{
+    options opts;
+    if (not parse_options(argc, argv, opts))
+        return -1;
+
+    std::vector<json_object> results;
+    uint16_t port = opts.port;
+
+    run_all<unet::tcp_connection>(opts, port, results);
+    run_all<unet::shm_socket>(opts, port, results);
+
+    json_object report;
+    report.add("benchmark", "shm")
+          .add("label", opts.label)
+          .add("quick", int(opts.quick))
+          .add("results", results);
+
+    if (opts.output.empty()) {
+        std::cout << report.str() << "\n";
+    } else {
+        std::ofstream out(opts.output);
+        out << report.str() << "\n";
+    }
+
+    for (const json_object& result : results)
+        std::cerr << result.str() << "\n";
+}
@@ -0,0 +1,153 @@
+// Counts socket-related syscalls made by the process by interposing the
+// libc wrappers.  The benchmark executable defines these symbols itself, so
+// every `::send`/`::recv`/... micronet makes resolves here first and we
+// forward to the real implementation found with dlsym(RTLD_NEXT).
+//
+// Include this from exactly one translation unit.
+
+#ifndef UNET_BENCH_SYSCALL_COUNTER_HPP
+#define UNET_BENCH_SYSCALL_COUNTER_HPP
+
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/uio.h>
+#include <poll.h>
+#include <dlfcn.h>
+
+#include "bench_common.hpp"
+
+#include <atomic>
+#include <array>
+#include <cstdint>
+
+namespace unet::bench
+{
+    enum class syscall_id : size_t
+    {
+        send,
+        recv,
+        sendto,
+        recvfrom,
+        sendmsg,
+        recvmsg,
+        writev,
+        accept,
+        accept4,
+        connect,
+        epoll_wait,
+        poll,
+        setsockopt,
+        getsockopt,
+
+        count
+    };
+
+    constexpr static std::array<const char*, static_cast<size_t>(syscall_id::count)> syscall_names = {
+        "send", "recv", "sendto", "recvfrom", "sendmsg", "recvmsg",
+        "writev", "accept", "accept4", "connect", "epoll_wait", "poll",
+        "setsockopt", "getsockopt",
+    };
+
+    using syscall_counts = std::array<uint64_t, static_cast<size_t>(syscall_id::count)>;
+
+    inline std::array<std::atomic<uint64_t>, static_cast<size_t>(syscall_id::count)> syscall_counters{};
+
+    inline syscall_counts syscall_snapshot() noexcept
+    {
+        syscall_counts rval{};
+        for (size_t i = 0; i < rval.size(); ++i)
+            rval[i] = syscall_counters[i].load(std::memory_order_relaxed);
+        return rval;
+    }
+
+    inline syscall_counts operator-(const syscall_counts& lhs, const syscall_counts& rhs) noexcept
+    {
+        syscall_counts rval{};
+        for (size_t i = 0; i < rval.size(); ++i)
+            rval[i] = lhs[i] - rhs[i];
+        return rval;
+    }
+
+    // non-zero counts by name, plus their total
+    inline json_object to_json(const syscall_counts& counts)
+    {
+        json_object rval;
+        uint64_t total = 0;
+        for (size_t i = 0; i < counts.size(); ++i)
+        {
+            if (counts[i] == 0)
+                continue;
+            rval.add(syscall_names[i], counts[i]);
+            total += counts[i];
+        }
+        rval.add("total", total);
+        return rval;
+    }
+
+    namespace detail
+    {
+        inline void count(syscall_id id) noexcept {
+            syscall_counters[static_cast<size_t>(id)].fetch_add(1, std::memory_order_relaxed);
+        }
+
+        template <typename Fn>
+        Fn real(const char* name) noexcept {
+            return reinterpret_cast<Fn>(dlsym(RTLD_NEXT, name));
+        }
+    }
+}
+
+#define UNET_BENCH_FORWARD(name, ...)                                                   \
+    unet::bench::detail::count(unet::bench::syscall_id::name);                          \
+    static auto real_fn = unet::bench::detail::real<decltype(&::name)>(#name);          \
+    return real_fn(__VA_ARGS__)
+
+extern "C"
+{
+    ssize_t send(int fd, const void* buf, size_t n, int flags) {
+        UNET_BENCH_FORWARD(send, fd, buf, n, flags);
+    }
+    ssize_t recv(int fd, void* buf, size_t n, int flags) {
+        UNET_BENCH_FORWARD(recv, fd, buf, n, flags);
+    }
+    ssize_t sendto(int fd, const void* buf, size_t n, int flags, const sockaddr* addr, socklen_t len) {
+        UNET_BENCH_FORWARD(sendto, fd, buf, n, flags, addr, len);
+    }
+    ssize_t recvfrom(int fd, void* buf, size_t n, int flags, sockaddr* addr, socklen_t* len) {
+        UNET_BENCH_FORWARD(recvfrom, fd, buf, n, flags, addr, len);
+    }
+    ssize_t sendmsg(int fd, const msghdr* msg, int flags) {
+        UNET_BENCH_FORWARD(sendmsg, fd, msg, flags);
+    }
+    ssize_t recvmsg(int fd, msghdr* msg, int flags) {
+        UNET_BENCH_FORWARD(recvmsg, fd, msg, flags);
+    }
+    ssize_t writev(int fd, const iovec* iov, int count) {
+        UNET_BENCH_FORWARD(writev, fd, iov, count);
+    }
+    int accept(int fd, sockaddr* addr, socklen_t* len) {
+        UNET_BENCH_FORWARD(accept, fd, addr, len);
+    }
+    int accept4(int fd, sockaddr* addr, socklen_t* len, int flags) {
+        UNET_BENCH_FORWARD(accept4, fd, addr, len, flags);
+    }
+    int connect(int fd, const sockaddr* addr, socklen_t len) {
+        UNET_BENCH_FORWARD(connect, fd, addr, len);
+    }
+    int epoll_wait(int epfd, epoll_event* events, int max_events, int timeout) {
+        UNET_BENCH_FORWARD(epoll_wait, epfd, events, max_events, timeout);
+    }
+    int poll(pollfd* fds, nfds_t nfds, int timeout) {
+        UNET_BENCH_FORWARD(poll, fds, nfds, timeout);
+    }
+    int setsockopt(int fd, int level, int name, const void* value, socklen_t len) {
+        UNET_BENCH_FORWARD(setsockopt, fd, level, name, value, len);
+    }
+    int getsockopt(int fd, int level, int name, void* value, socklen_t* len) {
+        UNET_BENCH_FORWARD(getsockopt, fd, level, name, value, len);
+    }
+}
+
+#undef UNET_BENCH_FORWARD
+
+#endif
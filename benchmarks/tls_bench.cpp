@@ -0,0 +1,300 @@
+// TLS over loopback: full handshake rate, how long a client that never
+// starts its handshake holds up accept(), and bulk throughput of
+// tls_socket next to plain tcp_socket.  Reports whether kernel TLS was
+// used for each direction, which needs the `tls` module
+// (/proc/sys/net/ipv4/tcp_available_ulp) and an OpenSSL built with KTLS.
+//
+// Build (from the repository root):
+//   g++ -std=c++20 -O2 -DUNET_EPOLL -Iinclude benchmarks/tls_bench.cpp -o tls_bench -pthread -ldl -lssl -lcrypto
+//
+// Usage:
+//   tls_bench [--quick] [--port N] [--label STR] [--out FILE]
+
+#include <micronet/tcp.hpp>
+#include <micronet/tls.hpp>
+
+#include "bench_common.hpp"
+#include "syscall_counter.hpp"
+
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/x509.h>
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+using namespace unet::bench;
+
+namespace
+{
+    struct options
+    {
+        bool quick = false;
+        uint16_t port = 19200;
+        std::string label;
+        std::string output;
+    };
+
+    // the name in the certificate, verified by the client
+    constexpr const char* loopback = "localhost";
+
+    // throwaway P-256 certificate for the server, written next to the key
+    bool write_self_signed(const std::string& cert_file, const std::string& key_file)
+    {
+        EVP_PKEY* key = EVP_EC_gen("P-256");
+        X509* cert = X509_new();
+        if (key == nullptr || cert == nullptr)
+            return false;
+
+        ASN1_INTEGER_set(X509_get_serialNumber(cert), 1);
+        X509_gmtime_adj(X509_getm_notBefore(cert), 0);
+        X509_gmtime_adj(X509_getm_notAfter(cert), 24 * 3600);
+        X509_set_pubkey(cert, key);
+        X509_NAME* name = X509_get_subject_name(cert);
+        X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, reinterpret_cast<const unsigned char*>("localhost"), -1, -1, 0);
+        X509_set_issuer_name(cert, name);
+        X509_sign(cert, key, EVP_sha256());
+
+        FILE* out_cert = std::fopen(cert_file.c_str(), "w");
+        FILE* out_key = std::fopen(key_file.c_str(), "w");
+        const bool ok = out_cert && out_key
+                        && PEM_write_X509(out_cert, cert) == 1
+                        && PEM_write_PrivateKey(out_key, key, nullptr, nullptr, 0, nullptr, nullptr) == 1;
+
+        if (out_cert) std::fclose(out_cert);
+        if (out_key) std::fclose(out_key);
+        X509_free(cert);
+        EVP_PKEY_free(key);
+        return ok;
+    }
+
+    json_object bench_handshakes(const options& opts, uint16_t port, const unet::tls_context& server_ctx, const unet::tls_context& client_ctx)
+    {
+        const size_t connections = opts.quick ? 500 : 5000;
+
+        unet::tls_socket listener;
+        listener.use_tls(server_ctx);
+        if (auto res = listener.listen(port, 128); not res.has_value())
+            return json_object{}.add("error", unet::explain(res.error()));
+
+        size_t accepted = 0;
+        std::thread server([&] {
+            for (size_t i = 0; i < connections; ++i) {
+                if (listener.accept().has_value())
+                    accepted++;
+            }
+        });
+
+        latency_histogram hist;
+        size_t failed = 0;
+        const auto start = bench_clock::now();
+        for (size_t i = 0; i < connections; ++i) {
+            unet::tls_socket client;
+            client.use_tls(client_ctx);
+
+            const auto connect_start = bench_clock::now();
+            if (client.connect(loopback, port).has_value())
+                hist.record(elapsed_ns(connect_start));
+            else
+                failed++;
+        }
+        server.join();
+        const double seconds = elapsed_ns(start) / 1e9;
+
+        json_object rval = to_json(hist);
+        rval.add("connections", accepted)
+            .add("failed", failed)
+            .add("seconds", seconds)
+            .add("handshakes_per_second", accepted / seconds);
+        return rval;
+    }
+
+    // a client that connects and never starts the handshake, followed by a
+    // real one: accept() fails the first after the handshake timeout and
+    // then serves the second
+    json_object bench_silent_client(uint16_t port, const unet::tls_context& server_ctx, const unet::tls_context& client_ctx)
+    {
+        unet::tls_socket listener;
+        listener.use_tls(server_ctx);
+        if (auto res = listener.listen(port, 128); not res.has_value())
+            return json_object{}.add("error", unet::explain(res.error()));
+
+        unet::tcp_socket silent;
+        if (auto res = silent.connect(loopback, port); not res.has_value())
+            return json_object{}.add("error", unet::explain(res.error()));
+
+        bool served = false;
+        std::thread client([&] {
+            unet::tls_socket real;
+            real.use_tls(client_ctx);
+            served = real.connect(loopback, port).has_value();
+        });
+
+        const auto start = bench_clock::now();
+        auto first = listener.accept();
+        const double held_ms = elapsed_ns(start) / 1e6;
+        auto second = listener.accept();
+        client.join();
+
+        json_object rval;
+        rval.add("handshake_timeout_ms", int64_t(server_ctx.handshake_timeout().count()))
+            .add("silent_result", first.has_value() ? std::string("accepted") : unet::explain(first.error()))
+            .add("held_ms", held_ms)
+            .add("next_accepted", int(second.has_value() && served));
+        return rval;
+    }
+
+    template <typename Socket>
+    json_object bench_bulk(const options& opts, uint16_t port, const unet::tls_context* server_ctx, const unet::tls_context* client_ctx)
+    {
+        constexpr static size_t chunk_size = 64 * 1024;
+        const size_t total_bytes = (opts.quick ? 64ull : 512ull) * 1024 * 1024;
+
+        Socket listener;
+        if constexpr (Socket::is_secure)
+            listener.use_tls(*server_ctx);
+        if (auto res = listener.listen(port, 128); not res.has_value())
+            return json_object{}.add("error", unet::explain(res.error()));
+
+        size_t received = 0;
+        bool ktls_recv = false;
+        std::thread server([&] {
+            auto conn = listener.accept();
+            if (not conn.has_value())
+                return;
+            if constexpr (Socket::is_secure)
+                ktls_recv = conn->tls_info().ktls_recv;
+
+            std::vector<char> buffer(chunk_size);
+            while (received < total_bytes) {
+                auto n = conn->recv_some(std::span<char>(buffer));
+                if (not n.has_value())
+                    break;
+                received += n.value();
+            }
+        });
+
+        bool ktls_send = false;
+        const auto start = bench_clock::now();
+        {
+            Socket client;
+            if constexpr (Socket::is_secure)
+                client.use_tls(*client_ctx);
+
+            if (client.connect(loopback, port).has_value())
+            {
+                if constexpr (Socket::is_secure)
+                    ktls_send = client.tls_info().ktls_send;
+
+                std::vector<char> chunk(chunk_size, 'x');
+                for (size_t sent = 0; sent < total_bytes; sent += chunk_size)
+                    client.send(std::span<const char>(chunk));
+            }
+            server.join();
+        }
+        const double seconds = elapsed_ns(start) / 1e9;
+
+        json_object rval;
+        rval.add("secure", int(Socket::is_secure))
+            .add("ktls_send", int(ktls_send))
+            .add("ktls_recv", int(ktls_recv))
+            .add("bytes", received)
+            .add("seconds", seconds)
+            .add("mib_per_second", received / seconds / (1024.0 * 1024.0));
+        return rval;
+    }
+
+    template <typename Fn>
+    json_object measure(const std::string& name, Fn&& fn)
+    {
+        std::cerr << "running " << name << "...\n";
+
+        const syscall_counts before = syscall_snapshot();
+        json_object rval = fn();
+        const syscall_counts after = syscall_snapshot();
+
+        json_object tagged;
+        tagged.add("name", name)
+              .add("results", rval)
+              .add("syscalls", to_json(after - before));
+        return tagged;
+    }
+
+    bool parse_options(int argc, char** argv, options& opts)
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            const std::string arg = argv[i];
+            const bool has_value = i + 1 < argc;
+
+            if (arg == "--quick")
+                opts.quick = true;
+            else if (arg == "--port" && has_value)
+                opts.port = static_cast<uint16_t>(std::stoi(argv[++i]));
+            else if (arg == "--label" && has_value)
+                opts.label = argv[++i];
+            else if (arg == "--out" && has_value)
+                opts.output = argv[++i];
+            else {
+                std::cerr << "usage: " << argv[0] << " [--quick] [--port N] [--label STR] [--out FILE]\n";
+                return false;
+            }
+        }
+        return true;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    options opts;
+    if (not parse_options(argc, argv, opts))
+        return -1;
+
+    const std::string cert_file = "/tmp/micronet_tls_bench_cert.pem";
+    const std::string key_file = "/tmp/micronet_tls_bench_key.pem";
+    if (not write_self_signed(cert_file, key_file)) {
+        std::cerr << "cannot create a certificate\n";
+        return -1;
+    }
+
+    auto server_ctx = unet::tls_context::server(cert_file, key_file);
+    auto client_ctx = unet::tls_context::client({ .ca_file = cert_file });
+    std::remove(cert_file.c_str());
+    std::remove(key_file.c_str());
+
+    if (not server_ctx.has_value() || not client_ctx.has_value()) {
+        std::cerr << "cannot set up TLS contexts\n";
+        return -1;
+    }
+
+    // bounds how long a client that never says hello holds up accept()
+    server_ctx->handshake_timeout(std::chrono::milliseconds(250));
+
+    std::vector<json_object> results;
+    uint16_t port = opts.port;
+
+    results.push_back(measure("handshakes", [&] { return bench_handshakes(opts, port++, *server_ctx, *client_ctx); }));
+    results.push_back(measure("silent_client", [&] { return bench_silent_client(port++, *server_ctx, *client_ctx); }));
+    results.push_back(measure("bulk_tcp", [&] { return bench_bulk<unet::tcp_socket>(opts, port++, nullptr, nullptr); }));
+    results.push_back(measure("bulk_tls", [&] { return bench_bulk<unet::tls_socket>(opts, port++, &*server_ctx, &*client_ctx); }));
+
+    json_object report;
+    report.add("benchmark", "tls")
+          .add("label", opts.label)
+          .add("quick", int(opts.quick))
+          .add("openssl", OpenSSL_version(OPENSSL_VERSION))
+          .add("results", results);
+
+    if (opts.output.empty()) {
+        std::cout << report.str() << "\n";
+    } else {
+        std::ofstream out(opts.output);
+        out << report.str() << "\n";
+    }
+
+    for (const json_object& result : results)
+        std::cerr << result.str() << "\n";
+}
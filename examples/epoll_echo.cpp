@@ -0,0 +1,69 @@
+#include <micronet/tcp.hpp>
+#include <micronet/connection_table.hpp>
+#include <iostream>
+
+// per-connection state, lives in the connection table
+struct client
+{
+    unet::tcp_connection conn;
+    size_t messages = 0;
+};
+
+int main()
+{
+    // one fd per socket, listens on a dual-stack IPv6 socket
+    unet::tcp_connection listener;
+
+    auto res = listener.listen(8999);
+    if (not res.has_value()) {
+        std::cout << unet::explain(res.error()) << "\n";
+        return -1;
+    }
+
+    int epoll_fd = epoll_create1(0);
+
+    // generation 0 is never handed out by the table, so an empty handle
+    // is free to mark the listener
+    epoll_event listen_event = unet::make_epoll_event({}, EPOLLIN);
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listener.native_socket(), &listen_event);
+
+    unet::connection_table<client> clients;
+    epoll_event events[64];
+
+    while (true) {
+        int count = epoll_wait(epoll_fd, events, 64, -1);
+
+        for (int i = 0; i < count; ++i) {
+            unet::connection_handle handle = unet::handle_from_event(events[i]);
+
+            if (not handle.is_valid()) {
+                auto conn = listener.accept();
+                if (not conn.has_value())
+                    continue;
+
+                int fd = conn->native_socket();
+                handle = clients.insert({ std::move(conn.value()) });
+
+                epoll_event event = unet::make_epoll_event(handle, EPOLLIN);
+                epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event);
+                continue;
+            }
+
+            // events for connections erased earlier in this batch are
+            // rejected here instead of reaching a reused slot
+            client* c = clients.find(handle);
+            if (c == nullptr)
+                continue;
+
+            auto received = c->conn.recv_all<std::string>();
+            if (not received.has_value()) {
+                // erasing closes the socket, which also removes it from epoll
+                clients.erase(handle);
+                continue;
+            }
+
+            c->messages++;
+            c->conn.send(received.value());
+        }
+    }
+}
@@ -0,0 +1,41 @@
+#include <micronet/tcp.hpp>
+#include <micronet/http.hpp>
+#include <iostream>
+
+int main()
+{
+    unet::tcp_socket sock;
+
+    auto res = sock.listen(8080);
+    if (not res.has_value()) {
+        std::cout << unet::explain(res.error()) << "\n";
+        return -1;
+    }
+
+    while (true) {
+        auto conn_maybe = sock.accept();
+        if (not conn_maybe.has_value())
+            continue;
+
+        unet::tcp_socket conn = std::move(conn_maybe.value());
+
+        // owns the receive buffer, the views in `head` point into it
+        unet::http::message_reader reader(conn);
+        unet::http::request_head head;
+
+        // keep-alive: serve requests until the client is done, pipelined
+        // requests are simply already in the reader's buffer
+        while (reader.read_request(head).has_value()) {
+            size_t body_size = 0;
+            reader.read_body([&](std::string_view piece) { body_size += piece.size(); });
+
+            std::cout << head.method << " " << head.target << " (" << body_size << " byte body)\n";
+
+            const bool keep_alive = head.keep_alive;
+            conn.send(std::string(keep_alive ? "HTTP/1.1 200 OK\r\nContent-Length: 6\r\n\r\nhello\n"
+                                             : "HTTP/1.1 200 OK\r\nContent-Length: 6\r\nConnection: close\r\n\r\nhello\n"));
+            if (not keep_alive)
+                break;
+        }
+    }
+}
@@ -6,21 +6,63 @@
 
 #if defined(__linux__) || defined(__linux)
 # include <sys/socket.h>
+# include <sys/sendfile.h>
 # include "detail/sockets_os_posix.hpp"
+# include "detail/timestamping.hpp"
 #elif defined(_WIN32)
 # include "detail/sockets_os_winsock2.hpp"
 #endif
 
 #include "detail/utility.hpp"
+#include "detail/io_counters.hpp"
+#include "detail/busy_poll.hpp"
+#include "detail/delimiter_scanner.hpp"
+#include "detail/byte_order.hpp"
+#include "detail/send_queue.hpp"
+#include "detail/pacing.hpp"
+#include "detail/accept_queue.hpp"
+#include "detail/crc32c.hpp"
+#include "detail/receive_wait.hpp"
+#include "detail/socket_storage.hpp"
+#include "line_reader.hpp"
 #include <string>
 #include <chrono>
 #include <cstring>
+#include <limits>
 #include <span>
+#include <thread>
+
+namespace unet::detail
+{
+    // session state of secure socket types, the real one is in tls.hpp
+    template <bool Secure>
+    class tls_state;
+
+    template <>
+    class tls_state<false> {};
+
+    // the rings of shared memory socket types, the real one is in shm.hpp
+    template <bool SharedMemory>
+    class shm_state;
+
+    template <>
+    class shm_state<false> {};
+
+    // traffic capture of captured socket types, the real one is in capture.hpp
+    template <bool Captured>
+    class capture_tap;
+
+    template <>
+    class capture_tap<false> {};
+}
 
 namespace unet
 {
     using namespace std::chrono_literals;
 
+    class tls_context;
+    struct tls_status;
+
     template <typename T, typename = int>
     struct has_init_hook : std::false_type {};
 
@@ -35,6 +77,73 @@ namespace unet
     struct has_close_hook<T, decltype((void) T::close_hook, 0)> : std::true_type {};
 
 
+    template <typename T, typename = int>
+    struct has_io_counters : std::false_type {};
+
+    template <typename T> requires (T::instrumented)
+    struct has_io_counters<T, decltype((void) T::instrumented, 0)> : std::true_type {};
+
+
+    template <typename T, typename = int>
+    struct has_shared_memory : std::false_type {};
+
+    template <typename T> requires (T::shared_memory)
+    struct has_shared_memory<T, decltype((void) T::shared_memory, 0)> : std::true_type {};
+
+
+    template <typename T, typename = int>
+    struct has_concurrent_send : std::false_type {};
+
+    template <typename T> requires (T::concurrent_send)
+    struct has_concurrent_send<T, decltype((void) T::concurrent_send, 0)> : std::true_type {};
+
+
+    template <typename T, typename = int>
+    struct has_capture : std::false_type {};
+
+    template <typename T> requires (T::captured)
+    struct has_capture<T, decltype((void) T::captured, 0)> : std::true_type {};
+
+
+    template <typename T, typename = int>
+    struct has_pacing : std::false_type {};
+
+    template <typename T> requires (T::paced)
+    struct has_pacing<T, decltype((void) T::paced, 0)> : std::true_type {};
+
+
+    // data path hooks, `void on_send(std::span<const char>) const` sees the
+    // bytes as they are handed to the kernel, `void on_recv(std::span<const char>)`
+    // as they are taken off it; taking std::span<char> instead may rewrite
+    // them in place, without changing their length
+    template <typename T, typename = int>
+    struct has_send_hook : std::false_type {};
+
+    template <typename T>
+    struct has_send_hook<T, decltype(std::declval<const T&>().on_send(std::declval<std::span<char>>()), 0)> : std::true_type {};
+
+
+    template <typename T, typename = int>
+    struct has_send_observer : std::false_type {};
+
+    template <typename T>
+    struct has_send_observer<T, decltype(std::declval<const T&>().on_send(std::declval<std::span<const char>>()), 0)> : std::true_type {};
+
+
+    template <typename T, typename = int>
+    struct has_recv_hook : std::false_type {};
+
+    template <typename T>
+    struct has_recv_hook<T, decltype(std::declval<T&>().on_recv(std::declval<std::span<char>>()), 0)> : std::true_type {};
+
+
+    template <typename T, typename = int>
+    struct has_recv_observer : std::false_type {};
+
+    template <typename T>
+    struct has_recv_observer<T, decltype(std::declval<T&>().on_recv(std::declval<std::span<const char>>()), 0)> : std::true_type {};
+
+
     template <typename T>
     concept suitable_socket_type = requires(T t) {
         t.domain;
@@ -49,45 +158,72 @@ namespace unet
         { t.operator[](0) };
     };
 
-    struct ip_socket_pair
-    {
-        os_socket_type ipv4;
-        os_socket_type ipv6;
-    };
-
     struct recv_opts {
         bool disable_wait : 1 = false;
         bool allow_partial : 1 = false;
 
+        // for the whole operation, however many receives it takes; waits
+        // in poll() and fails with error_code::timed_out once it passes,
+        // `.deadline = std::chrono::steady_clock::now() + 200ms`.  A read
+        // that times out after taking part of its message off the stream
+        // closes the socket, as what follows could no longer be framed.
+        std::chrono::steady_clock::time_point deadline{};
+
         // to ::recv flags, probably POSIX-only, TODO: figure out how to handle this in windows
         operator int() {
-            return MSG_DONTWAIT & disable_wait;
+            return disable_wait ? MSG_DONTWAIT : 0;
         }
     };
 
+    // Storage decides how many OS sockets are held, see detail/socket_storage.hpp
+    template <suitable_socket_type SocketType, typename Storage = detail::dual_stack_storage>
+    class basic_socket;
+
+    // one fd per socket, for large numbers of connections; listening uses a
+    // single dual-stack IPv6 socket instead of separate IPv4 and IPv6 ones
     template <suitable_socket_type SocketType>
-    class basic_socket : public SocketType, detail::os::socket
+    using basic_connection = basic_socket<SocketType, detail::single_socket_storage>;
+
+    template <suitable_socket_type SocketType, typename Storage>
+    class basic_socket : public SocketType, public Storage
     {
         public:
             constexpr static os_socket_type uninitialised  = detail::os::uninitialised_socket;
             constexpr static os_socket_type disabled       = detail::os::disabled_socket;
 
             constexpr static bool is_secure = SocketType::secure;
+            constexpr static bool is_instrumented = has_io_counters<SocketType>::value;
+            constexpr static bool is_shared_memory = has_shared_memory<SocketType>::value;
+            constexpr static bool is_concurrent_send = has_concurrent_send<SocketType>::value;
+            constexpr static bool is_paced = has_pacing<SocketType>::value;
+            constexpr static bool is_captured = has_capture<SocketType>::value;
+            constexpr static bool is_send_hooked = has_send_hook<SocketType>::value;
+            constexpr static bool is_send_transformed = is_send_hooked && not has_send_observer<SocketType>::value;
+            constexpr static bool is_recv_hooked = has_recv_hook<SocketType>::value;
+            constexpr static bool is_recv_transformed = is_recv_hooked && not has_recv_observer<SocketType>::value;
+            constexpr static bool is_crc32c_checked = std::is_base_of_v<crc32c_stage, SocketType>;
+            constexpr static bool is_single_socket = Storage::single_socket;
 
             constexpr static ssize_t recv_buffer_size = 1024;
+            constexpr static size_t wire_batch_size = 16 * 1024;
+            // what an observing on_send sums ahead of one send syscall, small
+            // enough to still be in L2 when the kernel copies it
+            constexpr static size_t observed_batch_size = 256 * 1024;
 
-            size_t mtu_size = 1200;
+            // a uint16_t rather than size_t so connections stay 12 bytes, IP
+            // caps a datagram at 64 KiB anyway; moved along with the socket
+            uint16_t mtu_size = 1200;
 
             basic_socket() noexcept;
             basic_socket(os_socket_type in_socket_fd, int protocol) noexcept;
             basic_socket(basic_socket&&) noexcept(std::is_nothrow_move_assignable<basic_socket>::value);
             basic_socket& operator=(basic_socket&&) noexcept;
 
-            basic_socket(const socket&) = delete;
+            basic_socket(const basic_socket&) = delete;
             ~basic_socket();
 
             constexpr bool operator==(const basic_socket& other) const {
-                return (socket_ipv4 == other.socket_ipv4) && (socket_ipv6 == other.socket_ipv6);
+                return Storage::same_sockets(other);
             }
 
             // connecting
@@ -96,14 +232,30 @@ namespace unet
             tl::expected<void, error_code> connect(const std::string& host, uint16_t port) noexcept;
 
             // for listening/accepting socket streams
-            tl::expected<void, error_code> listen(uint16_t port, int backlog_size = 20) noexcept requires (SocketType::type == SOCK_STREAM);
+            tl::expected<void, error_code> listen(uint16_t port, listen_opts = {}) noexcept requires (SocketType::type == SOCK_STREAM);
+            tl::expected<void, error_code> listen(uint16_t port, int backlog_size) noexcept requires (SocketType::type == SOCK_STREAM) {
+                return listen(port, listen_opts{ .backlog = backlog_size });
+            }
             tl::expected<basic_socket, error_code> accept(std::chrono::milliseconds = 0ms) noexcept requires (SocketType::type == SOCK_STREAM);
+            tl::expected<basic_connection<SocketType>, error_code> accept_connection(std::chrono::milliseconds = 0ms) noexcept requires (SocketType::type == SOCK_STREAM);
+
+            #if defined(__linux__) || defined(__linux)
+            // listener overload handling, see detail/accept_queue.hpp: how full
+            // the accept queue is, and accepting and dropping whatever is
+            // queued beyond `keep` without a handshake or a socket object
+            tl::expected<accept_queue_stats, error_code> accept_queue_info() const noexcept requires (SocketType::type == SOCK_STREAM);
+            tl::expected<size_t, error_code> shed_connections(size_t keep = 0, shed_mode = shed_mode::reset) noexcept requires (SocketType::type == SOCK_STREAM);
+            #endif
 
             // cleanup
             void close() noexcept;
 
             // state query
-            bool is_active() const noexcept { return (socket_ipv4 > 0) || (socket_ipv6 > 0); }
+            bool is_active() const noexcept { return Storage::has_active_socket(); }
+
+            // for reuse from a pool: nothing unread and no EOF from the peer,
+            // checked with a non-blocking peek
+            bool is_reusable() noexcept;
 
             // sending data
             template <typename T>
@@ -114,6 +266,11 @@ namespace unet
 
             tl::expected<size_t, error_code> send(const std::string& data) const noexcept;
 
+            // elements in network byte order, converted wire_batch_size bytes
+            // at a time; structs describe their fields, see detail/byte_order.hpp
+            template <typename T> requires wire_type<std::remove_cv_t<T>>
+            tl::expected<size_t, error_code> send_array(std::span<T> data) const noexcept requires (SocketType::type == SOCK_STREAM);
+
             // receiving data
             template <typename T>
             tl::expected<T, error_code> recv(recv_opts = {}) noexcept;
@@ -131,297 +288,632 @@ namespace unet
                 return recv_until<T>(d, opts);
             }
 
+            // the delimiter as a template argument, `recv_until<"\r\n", std::string>()`,
+            // gets a scanner specialised for it
+            template <delimiter Delim, suitable_container_type T>
+            tl::expected<void, error_code> recv_append_until(T& target, recv_opts opts = {}) noexcept {
+                return append_until(target, detail::static_scanner<Delim>{}, opts);
+            }
+
+            template <delimiter Delim, suitable_container_type T>
+            tl::expected<T, error_code> recv_until(recv_opts opts = {}) noexcept {
+                T rval{};
+                auto result = recv_append_until<Delim>(rval, opts);
+                if (not result.has_value())
+                    return tl::unexpected{result.error()};
+                return rval;
+            }
+
             template <suitable_container_type T>
             tl::expected<T, error_code> recv_all(recv_opts = {}) noexcept;
 
-            // for integration
-            ip_socket_pair native_sockets() const noexcept {
-                return {
-                    socket_ipv4,
-                    socket_ipv6
-                };
+            // fills `output` and converts it to host order in place; only the
+            // first receive honours disable_wait, the rest of the array is waited for
+            template <wire_type T>
+            tl::expected<void, error_code> recv_array(std::span<T> output, recv_opts = {}) noexcept requires (SocketType::type == SOCK_STREAM);
+
+            // whatever is queued, up to buffer.size(), with a single receive
+            tl::expected<size_t, error_code> recv_some(std::span<char> buffer, recv_opts = {}) noexcept;
+
+            // `for (std::string_view line : sock.lines('\n'))`, see line_reader.hpp
+            line_reader<basic_socket> lines(char delim = '\n', size_t max_line_length = 64 * 1024) noexcept {
+                return line_reader<basic_socket>(*this, delim, max_line_length);
             }
 
+            #if defined(__linux__) || defined(__linux)
+            // sendfile(2), or SSL_sendfile with kernel TLS; user-space TLS reads and encrypts
+            tl::expected<size_t, error_code> send_file(int file_fd, off_t offset, size_t count) noexcept requires (SocketType::type == SOCK_STREAM);
+
+            // kernel timestamping, TCP sockets must be connected before enabling
+            tl::expected<void, error_code> enable_timestamping(timestamp_source = timestamp_source::software) noexcept;
+
+            template <typename T>
+            tl::expected<send_result, error_code> send_timestamped(std::span<T> data) noexcept;
+
+            template <typename T>
+            tl::expected<timestamped<T>, error_code> recv_timestamped(recv_opts = {}) noexcept;
+
+            // drains reported TX stamps from the error queue without blocking
+            tl::expected<size_t, error_code> recv_tx_timestamps(std::span<tx_timestamp> output) noexcept;
+            #endif
+
+            // readiness, for event loops: the socket is only reported readable
+            // once `bytes` are queued, 1 to go back to the default; reads of a
+            // known size with a deadline do this by themselves while they
+            // wait, and put back the value set here after
+            tl::expected<void, error_code> set_recv_low_watermark(size_t bytes) noexcept requires (SocketType::type == SOCK_STREAM);
+
+            // busy polling: blocking receives spin on MSG_DONTWAIT for up to the
+            // budget before parking, trading a core for wakeup latency; the
+            // result says whether the kernel accepted SO_BUSY_POLL as well
+            tl::expected<bool, error_code> enable_busy_poll(busy_poll_opts = {}) noexcept;
+            void disable_busy_poll() noexcept;
+
+            // TLS, include tls.hpp; the context is used by connect() and, on
+            // a listener, for the sockets it accepts
+            void use_tls(const tls_context& context) noexcept requires is_secure;
+            tls_status tls_info() const noexcept requires is_secure;
+
+            // concurrent sends, enabled with `constexpr static bool concurrent_send = true`
+            // in SocketType: send() may be called from several threads at once,
+            // see detail/send_queue.hpp; bytes accepted but not yet written
+            size_t queued_send_bytes() const noexcept requires is_concurrent_send { return sendq.queued_bytes(); }
+
+            // pacing, enabled with `constexpr static bool paced = true` in SocketType:
+            // caps the send rate of this socket and, optionally, of a group
+            // of sockets, see detail/pacing.hpp; the result says whether the
+            // kernel enforces the socket's own rate with SO_MAX_PACING_RATE
+            tl::expected<bool, error_code> enable_pacing(pacing_opts) noexcept requires is_paced;
+            void disable_pacing() noexcept requires is_paced;
+            pacing_stats pacing_info() const noexcept requires is_paced { return pacer.stats(); }
+
+            // readable once a send refused with error_code::rate_limited
+            // would be admitted, for event loops using `wait = false`
+            tl::expected<int, error_code> pacing_timer() noexcept requires is_paced { return pacer.timer_fd(); }
+
+            // traffic capture, enabled with `constexpr static bool captured = true` in
+            // SocketType, see capture.hpp; overrides sampling and the filter
+            void capture_traffic(bool enabled) noexcept requires is_captured { tap.force(enabled); }
+
+            // integrity framing for SocketTypes deriving from crc32c_stage, see
+            // detail/crc32c.hpp: the bytes followed by their CRC32C, checked on
+            // receipt with error_code::checksum_mismatch on a difference
+            template <typename T>
+            tl::expected<size_t, error_code> send_checked(std::span<T> data) const noexcept requires is_crc32c_checked;
+
+            template <typename T>
+            tl::expected<void, error_code> recv_checked(std::span<T> output, recv_opts = {}) noexcept requires is_crc32c_checked;
+
+            // instrumentation, enabled with `constexpr static bool instrumented = true` in SocketType
+            io_counters counters() const noexcept requires is_instrumented { return recorder.counters.load(); }
+
+            // for integration, native_socket() and, for dual-stack storage, native_sockets() come from Storage
+
         private:
+            template <suitable_socket_type, typename> friend class basic_socket;
+
             tl::expected<size_t, error_code> send_raw(const char* dataptr, size_t size) const noexcept;
+            tl::expected<size_t, error_code> send_admitted(native_socket_type socket_fd, const char* dataptr, size_t size) const noexcept;
 
-            os_socket_type get_os_socket(const std::string& host, uint16_t port, int family) noexcept;
+            template <typename Accepted>
+            tl::expected<Accepted, error_code> accept_as(std::chrono::milliseconds timeout) noexcept;
 
             native_socket_type get_active_native_socket() const noexcept {
-                return static_cast<native_socket_type>(socket_ipv4 == disabled ? socket_ipv6 : socket_ipv4);
+                return Storage::active_socket();
+            }
+
+            // one receive syscall, `call` takes the ::recv flags; `expected`
+            // is how many bytes a read of known size still waits for, see
+            // detail/receive_wait.hpp
+            template <typename Syscall>
+            ssize_t receive(int flags, Syscall&& call, detail::receive_clock::time_point deadline = detail::no_deadline, size_t expected = 0) noexcept;
+
+            template <typename Syscall>
+            ssize_t receive_waiting(int flags, Syscall&& call, detail::receive_clock::time_point deadline, size_t expected) noexcept;
+
+            // ::send/::recv, through the TLS session for secure sockets and the
+            // rings for shared memory ones; captured sockets record the payload,
+            // then the on_send/on_recv hooks see it (stream sends are shown to
+            // on_send by send_raw() instead, piece by piece before the syscall)
+            ssize_t os_send(native_socket_type fd, const void* data, size_t size, int flags) const noexcept {
+                ssize_t n;
+                if constexpr (is_shared_memory)
+                    n = shm.write(fd, data, size, flags);
+                else if constexpr (is_secure)
+                    n = tls.write(fd, data, size, flags);
+                else
+                    n = ::send(fd, detail::os::ptr_cast(const_cast<void*>(data)), size, flags);
+
+                if constexpr (is_captured) {
+                    if (n > 0)
+                        tap.sent(fd, SocketType::type, data, n);
+                }
+                if constexpr (is_send_hooked && not is_send_transformed && SocketType::type != SOCK_STREAM) {
+                    if (n > 0)
+                        this->on_send(std::span<const char>(static_cast<const char*>(data), n));
+                }
+                return n;
             }
 
-            // TODO/FIXME: this probably needs to be changed later on to be dependant on SocketType,
-            // e.g. we don't need IP sockets for UNIX domain sockets.
-            os_socket_type socket_ipv6 = uninitialised;
-            os_socket_type socket_ipv4 = uninitialised;
+            ssize_t os_recv(native_socket_type fd, void* data, size_t size, int flags) noexcept {
+                ssize_t n;
+                if constexpr (is_shared_memory)
+                    n = shm.read(fd, data, size, flags);
+                else if constexpr (is_secure)
+                    n = tls.read(fd, data, size, flags);
+                else
+                    n = ::recv(fd, detail::os::ptr_cast(data), size, flags);
+
+                if constexpr (is_captured) {
+                    if (n > 0 && not (flags & MSG_PEEK))
+                        tap.received(fd, SocketType::type, data, n);
+                }
+                if constexpr (is_recv_hooked) {
+                    if (n > 0 && not (flags & MSG_PEEK))
+                        this->on_recv(std::span<char>(static_cast<char*>(data), n));
+                }
+                return n;
+            }
+
+            template <suitable_container_type T, typename Scanner>
+            tl::expected<void, error_code> append_until(T& target, const Scanner& scanner, recv_opts opts) noexcept;
+
+            // fits in the padding after mtu_size
+            uint16_t spin_budget_us = 0;
+
+            // mirrors the kernel SOF_TIMESTAMPING_OPT_ID counter, bytes for
+            // streams and datagrams otherwise
+            mutable uint32_t tx_timestamp_key = 0;
+
+            [[no_unique_address]] mutable detail::io_recorder<is_instrumented> recorder;
+            [[no_unique_address]] mutable detail::tls_state<is_secure> tls;
+            [[no_unique_address]] mutable detail::shm_state<is_shared_memory> shm;
+            [[no_unique_address]] mutable detail::send_queue<is_concurrent_send> sendq;
+            [[no_unique_address]] mutable detail::pacer<is_paced> pacer;
+            [[no_unique_address]] mutable detail::capture_tap<is_captured> tap;
+
+            static_assert(not (is_secure && is_shared_memory), "shared memory sockets are not encrypted");
+            static_assert(not is_concurrent_send || SocketType::type == SOCK_STREAM, "datagrams are sent whole already");
+            static_assert(not (is_paced && is_concurrent_send), "pace concurrent senders with a pacing_group of their own sockets");
+            static_assert(not ((is_send_hooked || is_recv_hooked) && is_concurrent_send), "concurrent sends are batched past the hooks");
+            static_assert(not is_send_transformed || SocketType::type == SOCK_STREAM, "rewritten sends are staged in pieces, datagrams would be split");
     };
 }
 
 namespace unet
 {
-    template <suitable_socket_type SockType>
-    basic_socket<SockType>::basic_socket() noexcept
+    template <suitable_socket_type SockType, typename Storage>
+    basic_socket<SockType, Storage>::basic_socket() noexcept
     {
         if constexpr(has_init_hook<SockType>::value) {
             this->init_hook();
         }
     }
 
-    template <suitable_socket_type SockType>
-    void basic_socket<SockType>::close() noexcept
+    template <suitable_socket_type SockType, typename Storage>
+    void basic_socket<SockType, Storage>::close() noexcept
     {
         if constexpr(has_close_hook<SockType>::value) {
             this->close_hook();
         }
 
-        if (socket_ipv6 > 0)
-            ::close(socket_ipv6);
-        if (socket_ipv4 > 0)
-            ::close(socket_ipv4);
+        if constexpr (is_secure)
+            tls.shutdown();
+        if constexpr (is_shared_memory)
+            shm.shutdown();
+        if constexpr (is_concurrent_send)
+            sendq.clear();
+        if constexpr (is_paced)
+            pacer.disable(disabled);
+        if constexpr (is_captured)
+            tap.reset();
+
+        Storage::close_sockets();
     }
 
-    template <suitable_socket_type SockType>
-    basic_socket<SockType>::~basic_socket()
+    template <suitable_socket_type SockType, typename Storage>
+    basic_socket<SockType, Storage>::~basic_socket()
     {
         close();
     }
 
-    template <suitable_socket_type SockType>
-    basic_socket<SockType>::basic_socket(basic_socket&& other) 
-    noexcept(std::is_nothrow_move_assignable<basic_socket<SockType>>::value) 
-        : detail::os::socket(std::move(other))
+    template <suitable_socket_type SockType, typename Storage>
+    basic_socket<SockType, Storage>::basic_socket(basic_socket&& other) 
+    noexcept(std::is_nothrow_move_assignable<basic_socket<SockType, Storage>>::value) 
+        : Storage(std::move(other))
     {
         *this = std::move(other);
     }
 
-    template <suitable_socket_type SockType>
-    basic_socket<SockType>& basic_socket<SockType>::operator=(basic_socket<SockType>&& other) noexcept
+    template <suitable_socket_type SockType, typename Storage>
+    basic_socket<SockType, Storage>& basic_socket<SockType, Storage>::operator=(basic_socket<SockType, Storage>&& other) noexcept
     {
         if (this == &other)
             return *this;
 
         close();
 
-        socket_ipv6 = other.socket_ipv6;
-        socket_ipv4 = other.socket_ipv4;
-
-        other.socket_ipv6 = other.socket_ipv6 == disabled ? disabled : uninitialised;
-        other.socket_ipv4 = other.socket_ipv4 == disabled ? disabled : uninitialised;
+        Storage::take_sockets(other);
+        mtu_size = other.mtu_size;
+        tx_timestamp_key = other.tx_timestamp_key;
+        spin_budget_us = other.spin_budget_us;
+        recorder = other.recorder;
+        if constexpr (is_secure)
+            tls = std::move(other.tls);
+        if constexpr (is_shared_memory)
+            shm = std::move(other.shm);
+        if constexpr (is_concurrent_send)
+            sendq = std::move(other.sendq);
+        if constexpr (is_paced)
+            pacer = std::move(other.pacer);
+        if constexpr (is_captured) {
+            tap = other.tap;
+            other.tap.reset();
+        }
 
         return *this;
     }
 
-    template <suitable_socket_type SockType>
-    os_socket_type basic_socket<SockType>::get_os_socket(const std::string& host, uint16_t port, int family) noexcept
+    template <suitable_socket_type SockType, typename Storage>
+    basic_socket<SockType, Storage>::basic_socket(os_socket_type in_socket_fd, int protocol) noexcept
     {
-        addrinfo    hints{};
-        addrinfo*   server_info = nullptr;
-        addrinfo*   info = nullptr;
-
-        const char yes = 1;
+        Storage::adopt_socket(in_socket_fd, protocol);
 
-        char portstr[6]; sprintf(portstr, "%d", port);
+        // TODO: do we need to call hooks here?
+    }
 
-        hints.ai_family = family;
-        hints.ai_socktype = SockType::type;
+    template <suitable_socket_type SockType, typename Storage>
+    tl::expected<void, error_code> basic_socket<SockType, Storage>::open(const std::string& host, uint16_t port) noexcept
+    {
+        return Storage::open_sockets(host, port, SockType::type);
+    }
 
-        if (host.empty()) {
-            hints.ai_flags = AI_PASSIVE;
+    template <suitable_socket_type SockType, typename Storage>
+    tl::expected<void, error_code> basic_socket<SockType, Storage>::connect(const std::string& host, uint16_t port) noexcept
+    {
+        static_assert(not is_secure || SockType::type == SOCK_STREAM, "TLS needs a stream socket");
+
+        auto connected = open(host, port);
+        if constexpr (is_secure) {
+            if (connected.has_value()) {
+                connected = tls.handshake(get_active_native_socket(), false, host);
+                if (not connected.has_value())
+                    close();
+            }
+        }
+        if constexpr (is_shared_memory) {
+            if (connected.has_value()) {
+                connected = shm.attach(get_active_native_socket());
+                if (not connected.has_value())
+                    close();
+            }
         }
+        return connected;
+    }
 
-        if (getaddrinfo(host.empty() ? nullptr : host.c_str(), portstr, &hints, &server_info) != 0)
-            return disabled;
+    template <suitable_socket_type SockType, typename Storage>
+    bool basic_socket<SockType, Storage>::is_reusable() noexcept
+    {
+        if (not is_active())
+            return false;
 
-        native_socket_type socket_fd;
+        const native_socket_type socket_fd = get_active_native_socket();
+        char byte;
+        const ssize_t n = recorder.received(false, [&] {
+            return os_recv(socket_fd, &byte, 1, MSG_PEEK | MSG_DONTWAIT);
+        }, false);
 
-        for (info = server_info; info != nullptr; info = info->ai_next)
-        {
-            if ((socket_fd = ::socket(info->ai_family, info->ai_socktype, info->ai_protocol)) == detail::os::socket_error)
-                continue;
-
-            if (family == AF_INET6)
-            {
-                if (setsockopt(socket_fd, IPPROTO_IPV6, IPV6_V6ONLY, &yes, sizeof(int)) == detail::os::socket_error)
-                {
-                    freeaddrinfo(server_info);
-                    return disabled;
-                }
-            }
-            if (setsockopt(socket_fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(int)) == detail::os::socket_error)
-            {
-                freeaddrinfo(server_info);
-                return disabled;
-            }
+        // data nobody asked for means a stale response, EOF a closed peer
+        return n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+    }
 
-            if (host.empty())
-            {
-                if (::bind(socket_fd, info->ai_addr, info->ai_addrlen) == detail::os::socket_error)
-                {
-                    ::close(socket_fd);
-                    continue;
-                }
-            } else {
-                if (::connect(socket_fd, info->ai_addr, info->ai_addrlen) == detail::os::socket_error)
-                {
-                    ::close(socket_fd);
-                    continue;
-                }
-            }
-            break;
-        }
+    template <suitable_socket_type SockType, typename Storage>
+    tl::expected<void, error_code> basic_socket<SockType, Storage>::listen(uint16_t port, listen_opts opts) noexcept
+    requires (SockType::type == SOCK_STREAM)
+    {
+        auto listen_sock = open(port);
+        if (not listen_sock.has_value())
+            return listen_sock;
 
-        freeaddrinfo(server_info);
-        if (info == nullptr)
-            return disabled;
+        auto listening = Storage::listen_sockets(opts.backlog > 0 ? opts.backlog : detail::max_listen_backlog());
+        if (not listening.has_value())
+            return listening;
 
-        return socket_fd;
+        if constexpr (SockType::domain != AF_UNIX) {
+            if (opts.defer_accept.count() > 0)
+                Storage::for_each_socket([&](native_socket_type fd) { detail::set_defer_accept(fd, opts.defer_accept); });
+        }
+        return {};
     }
 
-    template <suitable_socket_type SockType>
-    basic_socket<SockType>::basic_socket(os_socket_type in_socket_fd, int protocol) noexcept
+    #if defined(__linux__) || defined(__linux)
+    template <suitable_socket_type SockType, typename Storage>
+    tl::expected<accept_queue_stats, error_code> basic_socket<SockType, Storage>::accept_queue_info() const noexcept
+    requires (SockType::type == SOCK_STREAM)
     {
-        socket_ipv4 = protocol == AF_INET ? in_socket_fd : disabled;
-        socket_ipv6 = protocol == AF_INET6 ? in_socket_fd : disabled;
+        static_assert(SockType::domain != AF_UNIX, "the accept queue is only reported for TCP");
 
-        // TODO: do we need to call hooks here?
+        if (not is_active())
+            return tl::unexpected(error_code::no_active_socket);
+
+        accept_queue_stats rval;
+        bool ok = true;
+        Storage::for_each_socket([&](native_socket_type fd) { ok = detail::add_accept_queue(fd, rval) && ok; });
+        if (not ok)
+            return tl::unexpected(error_code::cannot_set_option);
+
+        detail::read_listen_counters(rval);
+        return rval;
     }
 
-    template <suitable_socket_type SockType>
-    tl::expected<void, error_code> basic_socket<SockType>::open(const std::string& host, uint16_t port) noexcept
+    template <suitable_socket_type SockType, typename Storage>
+    tl::expected<size_t, error_code> basic_socket<SockType, Storage>::shed_connections(size_t keep, shed_mode mode) noexcept
+    requires (SockType::type == SOCK_STREAM)
     {
-        if ((socket_ipv6 > 0) || (socket_ipv4 > 0))
-            return tl::unexpected(error_code::socket_already_open);
+        static_assert(SockType::domain != AF_UNIX, "the accept queue is only reported for TCP");
 
-        if (host.empty())
-        {
-            socket_ipv6 = get_os_socket(host, port, AF_INET6);
-            socket_ipv4 = get_os_socket(host, port, AF_INET);
-        } else {
-            socket_ipv6 = get_os_socket(host, port, AF_INET6);
-            if (socket_ipv6 > 0)
-                socket_ipv4 = disabled;
-            else
-                socket_ipv4 = get_os_socket(host, port, AF_INET);
-        }
+        if (not is_active())
+            return tl::unexpected(error_code::no_active_socket);
 
-        if ((socket_ipv6 >= 0) || (socket_ipv4 >= 0))
-            return {};
+        // with nothing to keep there is no need to know how much is queued
+        size_t excess = std::numeric_limits<size_t>::max();
+        if (keep > 0) {
+            accept_queue_stats queue;
+            bool ok = true;
+            Storage::for_each_socket([&](native_socket_type fd) { ok = detail::add_accept_queue(fd, queue) && ok; });
+            if (not ok)
+                return tl::unexpected(error_code::cannot_set_option);
+            excess = queue.queued > keep ? queue.queued - keep : 0;
+        }
 
-        return tl::unexpected(host.empty() ? error_code::cannot_open_socket : error_code::cannot_connect);
+        size_t shed = 0;
+        Storage::for_each_socket([&](native_socket_type fd) {
+            if (shed < excess)
+                shed += detail::shed_queued(fd, excess - shed, mode);
+        });
+        return shed;
     }
+    #endif
 
-    template <suitable_socket_type SockType>
-    tl::expected<void, error_code> basic_socket<SockType>::connect(const std::string& host, uint16_t port) noexcept
+    template <suitable_socket_type SockType, typename Storage>
+    tl::expected<basic_socket<SockType, Storage>, error_code> basic_socket<SockType, Storage>::accept(std::chrono::milliseconds timeout) noexcept
+    requires (SockType::type == SOCK_STREAM)
     {
-        return open(host, port);
+        return accept_as<basic_socket>(timeout);
     }
 
-    template <suitable_socket_type SockType>
-    tl::expected<void, error_code> basic_socket<SockType>::listen(uint16_t port, int backlog_size) noexcept
+    template <suitable_socket_type SockType, typename Storage>
+    tl::expected<basic_connection<SockType>, error_code> basic_socket<SockType, Storage>::accept_connection(std::chrono::milliseconds timeout) noexcept
     requires (SockType::type == SOCK_STREAM)
     {
-        auto listen_sock = open(port);
-        if (not listen_sock.has_value())
-            return listen_sock;
-
-        if (socket_ipv4 > 0)
-        {
-            auto status = listen_on_os_socket(socket_ipv4, backlog_size, AF_INET);
-            if (not status.has_value()) {
-                ::close(socket_ipv4);
-                socket_ipv4 = disabled;
-                return status;
-            }
-        }
-
-        if (socket_ipv4 > 0)
-        {
-            auto status = listen_on_os_socket(socket_ipv6, backlog_size, AF_INET6);
-            if (not status.has_value()) {
-                ::close(socket_ipv6);
-                socket_ipv6 = disabled;
-                return status;
-            }
-        }
-        return {};
+        return accept_as<basic_connection<SockType>>(timeout);
     }
 
-    template <suitable_socket_type SockType>
-    tl::expected<basic_socket<SockType>, error_code> basic_socket<SockType>::accept(std::chrono::milliseconds timeout) noexcept
-    requires (SockType::type == SOCK_STREAM)
+    template <suitable_socket_type SockType, typename Storage> template <typename Accepted>
+    tl::expected<Accepted, error_code> basic_socket<SockType, Storage>::accept_as(std::chrono::milliseconds timeout) noexcept
     {
-        if ((socket_ipv6 < 0) && (socket_ipv4 < 0))
+        if (not is_active())
             return tl::unexpected(error_code::no_active_socket);
 
         sockaddr_storage their_addr;
         socklen_t addr_size = sizeof(their_addr);
 
-        detail::os::platform_event_type event;
-        if (wait_listen(&event, 1, timeout) == -1)
-            return tl::unexpected(error_code::no_socket_to_accept);
+        auto listening = recorder.waited([&] { return Storage::wait_for_connection(timeout); });
+        if (not listening.has_value())
+            return tl::unexpected(listening.error());
 
-        os_socket_type new_sockfd = ::accept(native_socket_from_event(event),
-                                                 reinterpret_cast<sockaddr*>(&their_addr),
-                                                 &addr_size);
+        os_socket_type new_sockfd = ::accept(listening.value(),
+                                             reinterpret_cast<sockaddr*>(&their_addr),
+                                             &addr_size);
 
         if (new_sockfd == detail::os::socket_error)
             return tl::unexpected(error_code::failed_to_accept);
 
-        char s[INET6_ADDRSTRLEN];
-        inet_ntop(their_addr.ss_family,
-                  detail::get_in_addr(reinterpret_cast<sockaddr*>(&their_addr)),
-                  s, sizeof(s));
+        // IPv4 peers of a dual-stack listener show up as mapped IPv6 addresses
+        Accepted accepted(new_sockfd, their_addr.ss_family);
 
-        int af_type = native_socket_from_event(event) == socket_ipv4 ? AF_INET : AF_INET6;
+        if constexpr (is_secure) {
+            if (auto* context = tls.listening_context())
+                accepted.tls.use_context(context);
+
+            // a client that connects and never says hello holds the listener up
+            // for the accept timeout or the context's handshake timeout at most
+            auto handshake = accepted.tls.handshake(accepted.get_active_native_socket(), true, {}, timeout);
+            if (not handshake.has_value())
+                return tl::unexpected(handshake.error());
+        }
 
-        return basic_socket(new_sockfd, af_type);
+        if constexpr (is_shared_memory) {
+            auto created = accepted.shm.create(accepted.get_active_native_socket(), SockType::shm_ring_size);
+            if (not created.has_value())
+                return tl::unexpected(created.error());
+        }
+
+        return accepted;
     }
 
-    template <suitable_socket_type SockType> template <typename T>
-    tl::expected<size_t, error_code> basic_socket<SockType>::send(std::span<T> data) const noexcept
+    template <suitable_socket_type SockType, typename Storage> template <typename T>
+    tl::expected<size_t, error_code> basic_socket<SockType, Storage>::send(std::span<T> data) const noexcept
     {
-        return send_raw(data.data(), data.size() * sizeof(T));
+        return send_raw(reinterpret_cast<const char*>(data.data()), data.size_bytes());
     }
 
-    template <suitable_socket_type SockType>
-    tl::expected<size_t, error_code> basic_socket<SockType>::send(const std::string& data) const noexcept
+    template <suitable_socket_type SockType, typename Storage>
+    tl::expected<size_t, error_code> basic_socket<SockType, Storage>::send(const std::string& data) const noexcept
     {
         return send_raw(data.data(), data.size());
     }
 
-    template <suitable_socket_type SockType> template <typename T>
-    tl::expected<size_t, error_code> basic_socket<SockType>::send(const T& data) const noexcept
+    template <suitable_socket_type SockType, typename Storage> template <typename T>
+    tl::expected<size_t, error_code> basic_socket<SockType, Storage>::send(const T& data) const noexcept
     {
-        constexpr static int extent = std::extent_v<T>;
+        constexpr static size_t extent = std::extent_v<T>;
         if constexpr (extent == 0) {
-            char* dataptr = &data;
-            size_t data_size = extent == 0 ? sizeof(T) : extent * sizeof(decltype(data[0]));
-            return send_raw(dataptr, data_size);
+            const char* dataptr = reinterpret_cast<const char*>(&data);
+            return send_raw(dataptr, sizeof(T));
         } else {
-            const char* dataptr = &data[0];
-            size_t data_size = extent == 0 ? sizeof(T) : extent * sizeof(decltype(data[0]));
-            return send_raw(dataptr, data_size);
+            const char* dataptr = reinterpret_cast<const char*>(&data[0]);
+            return send_raw(dataptr, extent * sizeof(data[0]));
         }
     }
 
-    template <suitable_socket_type SockType>
-    tl::expected<size_t, error_code> basic_socket<SockType>::send_raw(const char* dataptr, size_t total_size) const noexcept
+    template <suitable_socket_type SockType, typename Storage> template <typename T> requires wire_type<std::remove_cv_t<T>>
+    tl::expected<size_t, error_code> basic_socket<SockType, Storage>::send_array(std::span<T> data) const noexcept
+    requires (SockType::type == SOCK_STREAM)
+    {
+        using element = std::remove_cv_t<T>;
+
+        if constexpr (not detail::needs_byte_swap<element>()) {
+            return send_raw(reinterpret_cast<const char*>(data.data()), data.size_bytes());
+        } else {
+            constexpr static size_t per_batch = std::max<size_t>(1, wire_batch_size / sizeof(element));
+
+            // the caller's array is left as it is
+            const std::byte* source = reinterpret_cast<const std::byte*>(data.data());
+            alignas(32) std::byte batch[per_batch * sizeof(element)];
+
+            size_t sent = 0;
+            for (size_t first = 0; first < data.size(); first += per_batch) {
+                const size_t count = std::min(per_batch, data.size() - first);
+                detail::swap_to_wire<element>(source + first * sizeof(element), batch, count);
+
+                auto result = send_raw(reinterpret_cast<const char*>(batch), count * sizeof(element));
+                if (not result.has_value())
+                    return sent ? sent : result;
+                sent += result.value();
+
+                // held back by pacing part way through the batch
+                if (result.value() < count * sizeof(element))
+                    break;
+            }
+            return sent;
+        }
+    }
+
+    template <suitable_socket_type SockType, typename Storage> template <typename T>
+    tl::expected<size_t, error_code> basic_socket<SockType, Storage>::send_checked(std::span<T> data) const noexcept
+    requires is_crc32c_checked
+    {
+        // the stage sums the bytes as they are sent, the trailer after them
+        // is summed as well but reset away by the next message
+        this->sent_crc = 0;
+        auto sent = send_raw(reinterpret_cast<const char*>(data.data()), data.size_bytes());
+        if (not sent.has_value() || sent.value() < data.size_bytes())
+            return sent;
+
+        const uint32_t crc = this->sent_checksum();
+        const char trailer[4] = { char(crc), char(crc >> 8), char(crc >> 16), char(crc >> 24) };
+        auto result = send_raw(trailer, sizeof(trailer));
+        if (not result.has_value())
+            return tl::unexpected(result.error());
+        return sent;
+    }
+
+    template <suitable_socket_type SockType, typename Storage>
+    tl::expected<size_t, error_code> basic_socket<SockType, Storage>::send_raw(const char* dataptr, size_t total_size) const noexcept
     {
         if (not is_active())
             return tl::unexpected(error_code::no_active_socket);
         
         const native_socket_type socket_fd = get_active_native_socket();
 
+        if constexpr (is_paced) {
+            // a stream goes out a burst at a time, each piece admitted on its
+            // own, so a large message doesn't leave as one burst; held back
+            // part way, the send comes back short like a non-blocking one
+            const size_t piece = SockType::type == SOCK_STREAM ? pacer.piece_size() : 0;
+            if (piece != 0 && total_size > piece) {
+                size_t sent = 0;
+                while (sent < total_size) {
+                    const size_t count = std::min(piece, total_size - sent);
+                    if (not pacer.admit(count)) {
+                        if (sent == 0)
+                            return tl::unexpected(error_code::rate_limited);
+                        return sent;
+                    }
+
+                    auto result = send_admitted(socket_fd, dataptr + sent, count);
+                    if (not result.has_value())
+                        return result;
+                    sent += result.value();
+                }
+                return sent;
+            }
+
+            if (not pacer.admit(total_size))
+                return tl::unexpected(error_code::rate_limited);
+        }
+
+        return send_admitted(socket_fd, dataptr, total_size);
+    }
+
+    template <suitable_socket_type SockType, typename Storage>
+    tl::expected<size_t, error_code> basic_socket<SockType, Storage>::send_admitted(native_socket_type socket_fd, const char* dataptr, size_t total_size) const noexcept
+    {
+        if constexpr (is_concurrent_send) {
+            // runs on whichever sender is flushing, never on two at once
+            return sendq.send(dataptr, total_size, [&](const iovec* batch, int count) {
+                ssize_t n;
+                if constexpr (is_secure || is_shared_memory) {
+                    n = recorder.sent(batch[0].iov_len, true, [&] { return os_send(socket_fd, batch[0].iov_base, batch[0].iov_len, 0); });
+                } else {
+                    size_t requested = 0;
+                    for (int i = 0; i < count; ++i)
+                        requested += batch[i].iov_len;
+                    n = recorder.sent(requested, true, [&] { return ::writev(socket_fd, batch, count); });
+                    if constexpr (is_captured) {
+                        if (n > 0)
+                            tap.sent(socket_fd, SockType::type, batch, count, n);
+                    }
+                }
+
+                if (n > 0)
+                    tx_timestamp_key += n;
+                return n;
+            });
+        }
+
+        if constexpr (is_send_hooked && SockType::type == SOCK_STREAM) {
+            // on_send sees each piece while it is in cache, right before the
+            // kernel copies it; a rewriting hook works on a copy so the
+            // caller's bytes are left as they are
+            alignas(32) char batch[is_send_transformed ? wire_batch_size : 1];
+
+            size_t sent = 0;
+            while (sent < total_size) {
+                const size_t count = std::min(is_send_transformed ? wire_batch_size : observed_batch_size, total_size - sent);
+                const char* piece = dataptr + sent;
+                if constexpr (is_send_transformed) {
+                    std::memcpy(batch, piece, count);
+                    this->on_send(std::span<char>(batch, count));
+                    piece = batch;
+                } else {
+                    this->on_send(std::span<const char>(piece, count));
+                }
+
+                for (size_t done = 0; done < count;) {
+                    ssize_t n = recorder.sent(count - done, true, [&] { return os_send(socket_fd, piece + done, count - done, 0); });
+                    if (n == -1)
+                        return tl::unexpected(error_code::failed_to_send);
+
+                    tx_timestamp_key += n;
+                    done += n;
+                }
+                sent += count;
+            }
+            return sent;
+        }
+
         size_t sent = 0;
         size_t left = total_size;
         int n = 0;
 
         while (sent < total_size) {
-            n = ::send(socket_fd, dataptr + sent, left, 0);
+            n = recorder.sent(left, true, [&] { return os_send(socket_fd, dataptr + sent, left, 0); });
             if (n == -1)
                 return tl::unexpected(error_code::failed_to_send);
 
+            tx_timestamp_key += SockType::type == SOCK_STREAM ? n : 1;
             sent += n;
             left -= n;
         }
@@ -429,10 +921,157 @@ namespace unet
         return sent;
     }
 
-    // TODO/FIXME: write straight into rval if sizeof(RecvType) < recv_buffer_size
-    template <suitable_socket_type SockType>
+    template <suitable_socket_type SockType, typename Storage>
+    tl::expected<bool, error_code> basic_socket<SockType, Storage>::enable_busy_poll(busy_poll_opts opts) noexcept
+    {
+        if (not is_active())
+            return tl::unexpected(error_code::no_active_socket);
+
+        spin_budget_us = detail::spin_budget_us(opts.spin_budget);
+
+        if (not opts.kernel_busy_poll)
+            return false;
+        return detail::set_kernel_busy_poll(get_active_native_socket(), std::chrono::microseconds(spin_budget_us));
+    }
+
+    template <suitable_socket_type SockType, typename Storage>
+    void basic_socket<SockType, Storage>::disable_busy_poll() noexcept
+    {
+        spin_budget_us = 0;
+        if (is_active())
+            detail::set_kernel_busy_poll(get_active_native_socket(), 0us);
+    }
+
+    template <suitable_socket_type SockType, typename Storage>
+    tl::expected<bool, error_code> basic_socket<SockType, Storage>::enable_pacing(pacing_opts opts) noexcept requires is_paced
+    {
+        if (not is_active())
+            return tl::unexpected(error_code::no_active_socket);
+
+        return pacer.enable(get_active_native_socket(), SockType::type == SOCK_STREAM && not is_shared_memory, opts);
+    }
+
+    template <suitable_socket_type SockType, typename Storage>
+    void basic_socket<SockType, Storage>::disable_pacing() noexcept requires is_paced
+    {
+        pacer.disable(is_active() ? get_active_native_socket() : disabled);
+    }
+
+    template <suitable_socket_type SockType, typename Storage> template <typename Syscall>
+    ssize_t basic_socket<SockType, Storage>::receive(int flags, Syscall&& call, detail::receive_clock::time_point deadline, size_t expected) noexcept
+    {
+        const bool may_block = not (flags & MSG_DONTWAIT);
+
+        if (may_block && spin_budget_us != 0)
+        {
+            // the spin ends with its budget or the receive's deadline, whichever is first
+            auto spin_deadline = detail::spin_clock::now() + std::chrono::microseconds(spin_budget_us);
+            if (deadline != detail::no_deadline)
+                spin_deadline = std::min(spin_deadline, deadline);
+            uint64_t polls = 0;
+
+            do {
+                const ssize_t n = recorder.received(false, [&] { return call(flags | MSG_DONTWAIT); }, not (flags & MSG_PEEK));
+                polls++;
+
+                if (n >= 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+                    recorder.spun(polls, true);
+                    return n;
+                }
+                detail::cpu_relax();
+            } while (detail::spin_clock::now() < spin_deadline);
+
+            recorder.spun(polls, false);
+        }
+
+        if (may_block && (deadline != detail::no_deadline || (SockType::type == SOCK_STREAM && expected >= detail::low_watermark_threshold)))
+            return receive_waiting(flags, call, deadline, expected);
+
+        return recorder.received(may_block, [&] { return call(flags); }, not (flags & MSG_PEEK));
+    }
+
+    // A first non-blocking attempt, then the wait.  Without a deadline that
+    // is a blocking receive, with MSG_WAITALL for a known size; with one it
+    // is poll(), held back by SO_RCVLOWAT for a known size, and another
+    // attempt.  TLS may buffer part of a message in the session, and shared
+    // memory bypasses the socket buffer, so neither gets either.
+    template <suitable_socket_type SockType, typename Storage> template <typename Syscall>
+    ssize_t basic_socket<SockType, Storage>::receive_waiting(int flags, Syscall&& call, detail::receive_clock::time_point deadline, size_t expected) noexcept
+    {
+        const bool consumes = not (flags & MSG_PEEK);
+        ssize_t n = recorder.received(false, [&] { return call(flags | MSG_DONTWAIT); }, consumes);
+        if (n >= 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+            return n;
+
+        constexpr bool plain_stream = SockType::type == SOCK_STREAM && not is_secure && not is_shared_memory;
+        const bool known_size = plain_stream && consumes && expected >= detail::low_watermark_threshold;
+
+        // the kernel waits for all of it in one call
+        if (known_size && deadline == detail::no_deadline)
+            return recorder.received(true, [&] { return call(flags | MSG_WAITALL); }, consumes);
+
+        // the watermark in place before, set_recv_low_watermark()'s or the
+        // default, is put back afterwards; 0 when it was left alone
+        const native_socket_type fd = get_active_native_socket();
+        size_t previous_watermark = 0;
+        if constexpr (plain_stream) {
+            if (known_size) {
+                const size_t wanted = std::min(expected, detail::low_watermark_limit);
+                const size_t current = detail::receive_low_watermark(fd);
+                if (current != 0 && current != wanted && detail::set_receive_low_watermark(fd, wanted))
+                    previous_watermark = current;
+            }
+        }
+
+        while (true) {
+            if (deadline == detail::no_deadline) {
+                n = recorder.received(true, [&] { return call(flags); }, consumes);
+                break;
+            }
+            if (detail::receive_clock::now() >= deadline) {
+                n = -1;
+                errno = ETIMEDOUT;
+                break;
+            }
+
+            recorder.waited([&] {
+                if constexpr (is_shared_memory)
+                    std::this_thread::sleep_for(std::min<detail::receive_clock::duration>(deadline - detail::receive_clock::now(), 50us));
+                else
+                    detail::os::wait_readable(fd, detail::time_left(deadline));
+                return 0;
+            });
+
+            n = recorder.received(false, [&] { return call(flags | MSG_DONTWAIT); }, consumes);
+            if (n >= 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+                break;
+        }
+
+        if (previous_watermark != 0) {
+            const int saved_errno = errno;
+            detail::set_receive_low_watermark(fd, previous_watermark);
+            errno = saved_errno;
+        }
+        return n;
+    }
+
+    template <suitable_socket_type SockType, typename Storage>
+    tl::expected<void, error_code> basic_socket<SockType, Storage>::set_recv_low_watermark(size_t bytes) noexcept
+    requires (SockType::type == SOCK_STREAM)
+    {
+        if (not is_active())
+            return tl::unexpected(error_code::no_active_socket);
+
+        if (not detail::set_receive_low_watermark(get_active_native_socket(), bytes))
+            return tl::unexpected(error_code::cannot_set_option);
+        return {};
+    }
+
+    // Receives straight into the value, so a known size is the size of each
+    // call and the wait for it covers exactly what is still missing.
+    template <suitable_socket_type SockType, typename Storage>
     template <typename RecvType>
-    tl::expected<RecvType, error_code> basic_socket<SockType>::recv(recv_opts opts) noexcept
+    tl::expected<RecvType, error_code> basic_socket<SockType, Storage>::recv(recv_opts opts) noexcept
     {
         // FIXME:
         (void)opts;
@@ -443,32 +1082,33 @@ namespace unet
         RecvType rval{};
 
         const native_socket_type raw_sockfd = get_active_native_socket();
-        std::array<std::byte, recv_buffer_size> chunk;
+        std::byte* output = reinterpret_cast<std::byte*>(&rval);
 
-        ssize_t bytes_remaining = sizeof(RecvType);
+        size_t bytes_remaining = sizeof(RecvType);
         size_t bytes_received = 0;
 
         while(true) {
-            chunk.fill(std::byte(0));
-
-            ssize_t bytes = ::recv(raw_sockfd,
-                                   os_ptr_cast(chunk.data()),
-                                   std::min(bytes_remaining, recv_buffer_size),
-                                   opts);
+            ssize_t bytes = receive(opts, [&](int flags) {
+                return os_recv(raw_sockfd, output + bytes_received, bytes_remaining, flags);
+            }, opts.deadline, bytes_remaining);
 
             if (bytes == 0) {
                 close();
                 return tl::unexpected(error_code::connection_reset_by_peer);
             }
             else if (bytes < 0) {
+                if (errno == ETIMEDOUT) {
+                    if (bytes_received > 0)
+                        close();
+                    return tl::unexpected(error_code::timed_out);
+                }
                 return tl::unexpected(error_code::recv_failed);
             }
 
-            std::memmove(reinterpret_cast<char*>(&rval) + bytes_received, chunk.data(), bytes);
             bytes_received += bytes;
             bytes_remaining -= bytes;
 
-            if (bytes_remaining <= 0)
+            if (bytes_remaining == 0)
                 break;
 
         }
@@ -476,57 +1116,99 @@ namespace unet
         return rval;
     };
 
-    // FIXME: this needs to use some sort of buffering, ::recving a byte at a time is horrible
-    template <suitable_socket_type SockType>
+    template <suitable_socket_type SockType, typename Storage>
     template <suitable_container_type T>
-    tl::expected<void, error_code> basic_socket<SockType>::recv_append_until(T& orig_target, std::span<uint8_t> pattern, recv_opts opts) noexcept
+    tl::expected<void, error_code> basic_socket<SockType, Storage>::recv_append_until(T& target, std::span<uint8_t> pattern, recv_opts opts) noexcept
     {
-        auto target = orig_target;
+        if (pattern.empty())
+            return {};
+
+        return append_until(target, detail::runtime_scanner(pattern), opts);
+    }
 
+    // Peeks at what is queued, scans it and then consumes up to the end of
+    // the match straight into target, so nothing past the delimiter is taken
+    // off the socket and no bytes are received twice.
+    template <suitable_socket_type SockType, typename Storage>
+    template <suitable_container_type T, typename Scanner>
+    tl::expected<void, error_code> basic_socket<SockType, Storage>::append_until(T& target, const Scanner& scanner, recv_opts opts) noexcept
+    {
         if (not is_active())
             return tl::unexpected(error_code::no_active_socket);
 
-        native_socket_type socket_fd = get_active_native_socket();
+        static_assert(not is_recv_transformed, "the delimiter is searched for before on_recv rewrites the bytes, use lines()");
 
-        size_t match_size = 0;
-        uint8_t recv_last;
+        const native_socket_type socket_fd = get_active_native_socket();
+        const size_t original_size = target.size();
 
+        std::array<uint8_t, recv_buffer_size> peeked;
         bool multiple_chunks = false;
 
+        // without a deadline a match that isn't queued yet after the first
+        // chunk is no_data_to_read (or partial), with one it is waited for
+        const bool waits_for_rest = opts.deadline != detail::no_deadline;
+
         while(true) {
-            ssize_t bytes = ::recv(socket_fd, os_ptr_cast(&recv_last), 1, multiple_chunks ? MSG_DONTWAIT | opts : opts);
+            const int flags = multiple_chunks && not waits_for_rest ? MSG_DONTWAIT | opts : opts;
+            ssize_t bytes = receive(flags | MSG_PEEK, [&](int peek_flags) {
+                return os_recv(socket_fd, peeked.data(), peeked.size(), peek_flags);
+            }, opts.deadline);
 
             if (bytes == 0) {
+                target.resize(original_size);
                 close();
                 return tl::unexpected(error_code::connection_reset_by_peer);
             } else if (bytes < 0) {
                 if (errno == EAGAIN || errno == EWOULDBLOCK) {
-                    if (opts.allow_partial) {
-                        std::swap(orig_target, target);
+                    if (opts.allow_partial)
                         return {};
-                    }
+                    target.resize(original_size);
                     return tl::unexpected(error_code::no_data_to_read);
                 }
+                if (errno == ETIMEDOUT) {
+                    // what was taken off the stream stays in target for a
+                    // partial read to resume from, and is lost otherwise
+                    if (multiple_chunks && not opts.allow_partial) {
+                        target.resize(original_size);
+                        close();
+                    }
+                    return tl::unexpected(error_code::timed_out);
+                }
+                target.resize(original_size);
                 return tl::unexpected(error_code::recv_failed);
             }
 
-            target.push_back(static_cast<typename T::value_type>(recv_last));
+            // a match that started in what target already holds, possibly
+            // from an earlier allow_partial call, ends first
+            const std::span<const uint8_t> held(reinterpret_cast<const uint8_t*>(target.data()), target.size());
+            size_t take = detail::straddling_match(scanner, held, peeked.data(), bytes);
+            bool found = take != 0;
+            if (not found) {
+                const size_t at = scanner.find(peeked.data(), bytes);
+                found = at != detail::no_match;
+                take = found ? at + scanner.size : size_t(bytes);
+            }
 
-            if (recv_last == pattern[match_size]) {
-                match_size++;
-                if (match_size == pattern.size())
-                    break;
+            const size_t old_size = target.size();
+            target.resize(old_size + take);
+            ssize_t consumed = recorder.received(false, [&] {
+                return os_recv(socket_fd, target.data() + old_size, take, 0);
+            });
+
+            if (consumed != ssize_t(take)) {
+                target.resize(original_size);
+                return tl::unexpected(error_code::recv_failed);
             }
+
+            if (found)
+                return {};
             multiple_chunks = true;
         }
-
-        std::swap(orig_target, target);
-        return {};
     }
 
-    template <suitable_socket_type SockType>
+    template <suitable_socket_type SockType, typename Storage>
     template <suitable_container_type T>
-    tl::expected<T, error_code> basic_socket<SockType>::recv_until(std::span<uint8_t> pattern, recv_opts flags) noexcept
+    tl::expected<T, error_code> basic_socket<SockType, Storage>::recv_until(std::span<uint8_t> pattern, recv_opts flags) noexcept
     {
         T rval{};
         auto result = recv_append_until(rval, pattern, flags);
@@ -536,13 +1218,10 @@ namespace unet
         return rval;
     }
 
-    template <suitable_socket_type SockType>
+    template <suitable_socket_type SockType, typename Storage>
     template <suitable_container_type T>
-    tl::expected<T, error_code> basic_socket<SockType>::recv_all(recv_opts opts) noexcept
+    tl::expected<T, error_code> basic_socket<SockType, Storage>::recv_all(recv_opts opts) noexcept
     {
-        // FIXME:
-        (void)opts;
-
         if (not is_active())
             return tl::unexpected(error_code::no_active_socket);
 
@@ -560,12 +1239,19 @@ namespace unet
         while(true)
         {
             chunk.fill(std::byte(0));
-            ssize_t bytes = ::recv(socket_fd, os_ptr_cast(chunk.data()), recv_buffer_size, multiple_chunks ? MSG_DONTWAIT : no_flags);
+            ssize_t bytes = receive(multiple_chunks ? MSG_DONTWAIT : no_flags, [&](int flags) {
+                return os_recv(socket_fd, chunk.data(), recv_buffer_size, flags);
+            }, opts.deadline);
 
             if (bytes == 0) {
                 close();
                 return tl::unexpected(error_code::connection_reset_by_peer);
             } else if (bytes < 0) {
+                // the previous chunk happened to fill the buffer exactly, return what we have
+                if (multiple_chunks && (errno == EAGAIN || errno == EWOULDBLOCK))
+                    break;
+                if (errno == ETIMEDOUT)
+                    return tl::unexpected(error_code::timed_out);
                 return tl::unexpected(error_code::recv_failed);
             }
 
@@ -581,21 +1267,295 @@ namespace unet
 
         return rval;
     }
+
+    template <suitable_socket_type SockType, typename Storage> template <wire_type T>
+    tl::expected<void, error_code> basic_socket<SockType, Storage>::recv_array(std::span<T> output, recv_opts opts) noexcept
+    requires (SockType::type == SOCK_STREAM)
+    {
+        if (not is_active())
+            return tl::unexpected(error_code::no_active_socket);
+
+        const native_socket_type socket_fd = get_active_native_socket();
+        std::byte* bytes = reinterpret_cast<std::byte*>(output.data());
+        const size_t total = output.size_bytes();
+
+        size_t received = 0;
+        size_t converted = 0;
+        while (received < total) {
+            ssize_t n = receive(received == 0 ? int(opts) : 0, [&](int flags) {
+                return os_recv(socket_fd, bytes + received, total - received, flags);
+            }, opts.deadline, total - received);
+
+            if (n == 0) {
+                close();
+                return tl::unexpected(error_code::connection_reset_by_peer);
+            } else if (n < 0) {
+                if (received == 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                    return tl::unexpected(error_code::no_data_to_read);
+                if (errno == ETIMEDOUT) {
+                    if (received > 0)
+                        close();
+                    return tl::unexpected(error_code::timed_out);
+                }
+                return tl::unexpected(error_code::recv_failed);
+            }
+            received += n;
+
+            // whole elements are converted while still in cache
+            const size_t complete = received / sizeof(T);
+            std::byte* first = bytes + converted * sizeof(T);
+            detail::swap_to_wire<T>(first, first, complete - converted);
+            converted = complete;
+        }
+
+        return {};
+    }
+
+    template <suitable_socket_type SockType, typename Storage>
+    tl::expected<size_t, error_code> basic_socket<SockType, Storage>::recv_some(std::span<char> buffer, recv_opts opts) noexcept
+    {
+        if (not is_active())
+            return tl::unexpected(error_code::no_active_socket);
+
+        const native_socket_type socket_fd = get_active_native_socket();
+        ssize_t bytes = receive(opts, [&](int flags) {
+            return os_recv(socket_fd, buffer.data(), buffer.size(), flags);
+        }, opts.deadline);
+
+        if (bytes == 0) {
+            close();
+            return tl::unexpected(error_code::connection_reset_by_peer);
+        } else if (bytes < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return tl::unexpected(error_code::no_data_to_read);
+            if (errno == ETIMEDOUT)
+                return tl::unexpected(error_code::timed_out);
+            return tl::unexpected(error_code::recv_failed);
+        }
+
+        return size_t(bytes);
+    }
+
+    template <suitable_socket_type SockType, typename Storage> template <typename T>
+    tl::expected<void, error_code> basic_socket<SockType, Storage>::recv_checked(std::span<T> output, recv_opts opts) noexcept
+    requires is_crc32c_checked
+    {
+        static_assert(std::is_trivially_copyable_v<T>, "recv_checked writes straight into the object representation");
+        static_assert(SockType::type == SOCK_STREAM, "the trailer follows the message on the stream");
+
+        this->received_crc = 0;
+        auto result = recv_array(std::span<char>(reinterpret_cast<char*>(output.data()), output.size_bytes()), opts);
+        if (not result.has_value())
+            return result;
+
+        const uint32_t crc = this->received_checksum();
+        unsigned char trailer[4];
+        result = recv_array(std::span<char>(reinterpret_cast<char*>(trailer), sizeof(trailer)), recv_opts{ .deadline = opts.deadline });
+        if (not result.has_value()) {
+            // the message is off the stream already, its trailer would be read as the next one's
+            if (result.error() == error_code::timed_out)
+                close();
+            return result;
+        }
+
+        const uint32_t expected = trailer[0] | uint32_t(trailer[1]) << 8 | uint32_t(trailer[2]) << 16 | uint32_t(trailer[3]) << 24;
+        if (crc != expected)
+            return tl::unexpected(error_code::checksum_mismatch);
+        return {};
+    }
+
+    #if defined(__linux__) || defined(__linux)
+    template <suitable_socket_type SockType, typename Storage>
+    tl::expected<size_t, error_code> basic_socket<SockType, Storage>::send_file(int file_fd, off_t offset, size_t count) noexcept
+    requires (SockType::type == SOCK_STREAM)
+    {
+        static_assert(not is_shared_memory, "send_file writes to the fd, not the rings");
+        static_assert(not is_send_hooked, "sendfile bypasses on_send");
+
+        if (not is_active())
+            return tl::unexpected(error_code::no_active_socket);
+
+        const native_socket_type socket_fd = get_active_native_socket();
+        size_t sent = 0;
+
+        while (sent < count) {
+            ssize_t n;
+            if constexpr (is_secure) {
+                if (not tls.ktls_send()) {
+                    // encrypted in user space either way, so read and send
+                    std::array<char, 16 * 1024> chunk;
+                    n = ::pread(file_fd, chunk.data(), std::min(chunk.size(), count - sent), offset + sent);
+                    if (n > 0) {
+                        auto result = send_raw(chunk.data(), n);
+                        if (not result.has_value()) {
+                            if (result.error() == error_code::rate_limited && sent != 0)
+                                return sent;
+                            return tl::unexpected(result.error());
+                        }
+                        // held back by pacing, the rest goes with the next call
+                        if (result.value() < size_t(n))
+                            return sent + result.value();
+                    }
+                } else {
+                    n = recorder.sent(count - sent, true, [&] {
+                        return tls.sendfile(socket_fd, file_fd, offset + sent, count - sent);
+                    });
+                }
+            } else {
+                off_t position = offset + sent;
+                n = recorder.sent(count - sent, true, [&] {
+                    return ::sendfile(socket_fd, file_fd, &position, count - sent);
+                });
+            }
+
+            if (n < 0)
+                return tl::unexpected(error_code::failed_to_send);
+            if (n == 0)
+                break;  // end of file
+
+            if constexpr (not is_secure)
+                tx_timestamp_key += n;
+            sent += n;
+        }
+
+        return sent;
+    }
+
+    template <suitable_socket_type SockType, typename Storage>
+    tl::expected<void, error_code> basic_socket<SockType, Storage>::enable_timestamping(timestamp_source source) noexcept
+    {
+        static_assert(not is_shared_memory, "nothing to stamp, shared memory bypasses the kernel");
+
+        if (not is_active())
+            return tl::unexpected(error_code::no_active_socket);
+
+        const native_socket_type socket_fd = get_active_native_socket();
+        const int flags = detail::timestamping_flags(source, SockType::type == SOCK_STREAM);
+
+        if (setsockopt(socket_fd, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags)) == -1)
+            return tl::unexpected(error_code::cannot_set_option);
+
+        tx_timestamp_key = SockType::type == SOCK_STREAM ? detail::unacked_bytes(socket_fd) : 0;
+        return {};
+    }
+
+    template <suitable_socket_type SockType, typename Storage> template <typename T>
+    tl::expected<send_result, error_code> basic_socket<SockType, Storage>::send_timestamped(std::span<T> data) noexcept
+    {
+        auto sent = send_raw(reinterpret_cast<const char*>(data.data()), data.size_bytes());
+        if (not sent.has_value())
+            return tl::unexpected(sent.error());
+
+        // for streams the kernel keys the stamp by the last byte, for datagrams by the datagram
+        return send_result{ sent.value(), tx_timestamp_key - 1 };
+    }
+
+    template <suitable_socket_type SockType, typename Storage>
+    template <typename RecvType>
+    tl::expected<timestamped<RecvType>, error_code> basic_socket<SockType, Storage>::recv_timestamped(recv_opts opts) noexcept
+    {
+        static_assert(std::is_trivially_copyable_v<RecvType>, "recv_timestamped writes straight into the object representation");
+        static_assert(not is_shared_memory, "timestamps come from the kernel, shared memory bypasses it");
+        static_assert(not is_secure, "kernel receive stamps are per segment, not per TLS record");
+
+        if (not is_active())
+            return tl::unexpected(error_code::no_active_socket);
+
+        timestamped<RecvType> rval{};
+
+        const native_socket_type raw_sockfd = get_active_native_socket();
+        size_t bytes_received = 0;
+
+        while (bytes_received < sizeof(RecvType)) {
+            iovec iov{ reinterpret_cast<char*>(&rval.data) + bytes_received, sizeof(RecvType) - bytes_received };
+            alignas(cmsghdr) char control[detail::timestamp_control_size];
+
+            msghdr msg{};
+            msg.msg_iov = &iov;
+            msg.msg_iovlen = 1;
+            msg.msg_control = control;
+            msg.msg_controllen = sizeof(control);
+
+            ssize_t bytes = receive(opts, [&](int flags) {
+                return ::recvmsg(raw_sockfd, &msg, flags);
+            }, opts.deadline, sizeof(RecvType) - bytes_received);
+
+            if (bytes == 0) {
+                close();
+                return tl::unexpected(error_code::connection_reset_by_peer);
+            }
+            else if (bytes < 0) {
+                if (errno == ETIMEDOUT) {
+                    if (bytes_received > 0)
+                        close();
+                    return tl::unexpected(error_code::timed_out);
+                }
+                return tl::unexpected(error_code::recv_failed);
+            }
+
+            if constexpr (is_captured)
+                tap.received(raw_sockfd, SockType::type, iov.iov_base, bytes);
+            if constexpr (is_recv_hooked)
+                this->on_recv(std::span<char>(static_cast<char*>(iov.iov_base), bytes));
+
+            // the stamp of the segment that carried the first bytes
+            if (bytes_received == 0)
+                rval.timestamp = detail::parse_rx_timestamp(msg);
+
+            bytes_received += bytes;
+        }
+
+        return rval;
+    }
+
+    template <suitable_socket_type SockType, typename Storage>
+    tl::expected<size_t, error_code> basic_socket<SockType, Storage>::recv_tx_timestamps(std::span<tx_timestamp> output) noexcept
+    {
+        if (not is_active())
+            return tl::unexpected(error_code::no_active_socket);
+
+        const native_socket_type socket_fd = get_active_native_socket();
+        size_t count = 0;
+
+        while (count < output.size()) {
+            alignas(cmsghdr) char control[detail::timestamp_control_size];
+
+            msghdr msg{};
+            msg.msg_control = control;
+            msg.msg_controllen = sizeof(control);
+
+            if (::recvmsg(socket_fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) == -1) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK)
+                    break;
+                return tl::unexpected(error_code::recv_failed);
+            }
+
+            if (detail::parse_tx_timestamp(msg, output[count]))
+                count++;
+        }
+
+        return count;
+    }
+    #endif
 }
 
 #ifndef _WIN32
 namespace std
 {
-    template <unet::suitable_socket_type SockType> struct hash<unet::basic_socket<SockType>>
+    template <unet::suitable_socket_type SockType, typename Storage> struct hash<unet::basic_socket<SockType, Storage>>
     {
-        size_t operator()(const unet::basic_socket<SockType>& sock) const
+        size_t operator()(const unet::basic_socket<SockType, Storage>& sock) const
         {
-            // this is assumed, so check it
-            static_assert(sizeof(size_t) >= sizeof(unet::os_socket_type) * 2, 
-                    "FIXME/BUG: Implementation assumes sizeof(size_t) is at least twice sizeof(os::socket_type)\n");
+            if constexpr (unet::basic_socket<SockType, Storage>::is_single_socket) {
+                return size_t(sock.native_socket());
+            } else {
+                // this is assumed, so check it
+                static_assert(sizeof(size_t) >= sizeof(unet::os_socket_type) * 2, 
+                        "FIXME/BUG: Implementation assumes sizeof(size_t) is at least twice sizeof(os::socket_type)\n");
 
-            unet::ip_socket_pair socks = sock.native_sockets();
-            return (size_t(socks.ipv6) << (sizeof(unet::os_socket_type) * 8)) | socks.ipv4;
+                unet::ip_socket_pair socks = sock.native_sockets();
+                return (size_t(socks.ipv6) << (sizeof(unet::os_socket_type) * 8)) | socks.ipv4;
+            }
         }
     };
 }
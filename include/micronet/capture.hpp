@@ -0,0 +1,895 @@
+#ifndef UNET_CAPTURE_HPP
+#define UNET_CAPTURE_HPP
+
+// Traffic capture for socket types with `captured = true`:
+//
+//     struct socktype_tcp_captured : unet::socktype_tcp
+//     {
+//         constexpr static bool captured = true;
+//     };
+//
+//     unet::start_capture({ .path = "trace.pcapng" });
+//     ...
+//     unet::stop_capture();
+//
+// Every send and receive copies its payload, a timestamp and a connection
+// id into a ring owned by the calling thread.  A background writer merges
+// the rings in timestamp order into a pcapng file or a compact binary log.
+// Sockets never wait for the writer: a record that doesn't fit in the
+// ring is dropped and counted.  Socket types without the flag carry no
+// state and make no calls; captured ones cost a relaxed load while no
+// capture is running.
+//
+// The pcapng output is raw IP (LINKTYPE_RAW).  Its IPv4/IPv6 and TCP/UDP
+// headers are made up from the socket's addresses, with TCP sequence
+// numbers counting each direction's payload bytes and checksums left
+// zero.  Non-IP sockets (shared memory) show up as 127.0.0.1 talking to
+// 127.0.0.2, with the connection id as the port.
+//
+// The binary log is "UNETCAP1" followed by records.  Each record is a
+// detail::capture_record_header in host byte order, then `captured`
+// payload bytes; connection records carry a
+// detail::capture_connection_record instead of a payload.
+//
+// send_file() isn't captured, as the bytes never pass through user space.
+
+#include "basic_socket.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+namespace unet
+{
+    enum class capture_format { pcapng, binary };
+
+    // what a filter gets to see, once per connection
+    struct capture_connection
+    {
+        uint32_t id;
+        int type;                   // SOCK_STREAM or SOCK_DGRAM
+        sockaddr_storage local;
+        sockaddr_storage peer;      // zeroed for unconnected datagram sockets
+    };
+
+    struct capture_opts
+    {
+        std::string path;
+        capture_format format = capture_format::pcapng;
+
+        size_t ring_bytes = 4 * 1024 * 1024;    // per thread, set by the thread's first capture
+        uint32_t payload_limit = 65535;         // bytes kept of each send or receive
+        uint32_t sample_one_in = 1;             // every n-th connection, by id
+
+        // called on the socket's thread the first time a sampled connection
+        // sends or receives; false leaves the connection out
+        std::function<bool(const capture_connection&)> filter{};
+
+        std::chrono::milliseconds flush_interval{10};
+    };
+
+    struct capture_stats
+    {
+        uint64_t connections = 0;       // connections in the output
+        uint64_t records = 0;           // sends and receives written
+        uint64_t bytes = 0;             // payload bytes written
+        uint64_t dropped_records = 0;   // did not fit in their thread's ring
+        uint64_t dropped_bytes = 0;
+    };
+
+    tl::expected<void, error_code> start_capture(capture_opts opts) noexcept;
+
+    // drains what the rings hold and closes the output
+    capture_stats stop_capture() noexcept;
+
+    capture_stats capture_info() noexcept;
+}
+
+namespace unet::detail
+{
+    enum class capture_kind : uint8_t { padding, connection, sent, received };
+
+    struct capture_record_header
+    {
+        uint64_t timestamp_ns;      // CLOCK_REALTIME
+        uint32_t session;
+        uint32_t connection;
+        uint32_t captured;          // payload bytes that follow
+        uint32_t original;          // bytes the socket sent or received
+        capture_kind kind;
+        uint8_t reserved[7];
+    };
+
+    static_assert(sizeof(capture_record_header) == 32);
+
+    struct capture_connection_record
+    {
+        int32_t type;
+        uint32_t reserved;
+        sockaddr_storage local;
+        sockaddr_storage peer;
+    };
+
+    // the capture being written, 0 while none is
+    inline std::atomic<uint32_t> capture_session = 0;
+
+    inline uint64_t capture_now_ns() noexcept
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+
+    // Single-producer/single-consumer byte ring.  Records are 8-byte
+    // aligned and never wrap: a record that doesn't fit before the end
+    // starts over at the beginning, behind a padding record when there is
+    // room for its header.
+    class capture_ring
+    {
+        public:
+            explicit capture_ring(size_t bytes) noexcept
+            {
+                capacity = 4096;
+                while (capacity < bytes)
+                    capacity <<= 1;
+                buffer.reset(new (std::nothrow) char[capacity]);
+                if (buffer == nullptr)
+                    capacity = 0;
+            }
+
+            bool valid() const noexcept { return buffer != nullptr; }
+
+            // most payload a record can carry
+            size_t max_payload() const noexcept { return capacity / 2 - sizeof(capture_record_header); }
+
+            // producer; copies `header.captured` bytes gathered from `parts`
+            bool push(const capture_record_header& header, const iovec* parts, int count) noexcept
+            {
+                const size_t need = align(sizeof(header) + header.captured);
+                const size_t position = head.load(std::memory_order_relaxed);
+                const size_t to_end = capacity - (position & (capacity - 1));
+                const size_t skip = to_end < need ? to_end : 0;
+
+                if (position + skip + need - cached_tail > capacity) {
+                    cached_tail = tail.load(std::memory_order_acquire);
+                    if (position + skip + need - cached_tail > capacity) {
+                        dropped_records.store(dropped_records.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                        dropped_bytes.store(dropped_bytes.load(std::memory_order_relaxed) + header.original, std::memory_order_relaxed);
+                        return false;
+                    }
+                }
+
+                if (skip >= sizeof(header)) {
+                    capture_record_header padding{};
+                    padding.kind = capture_kind::padding;
+                    std::memcpy(buffer.get() + (position & (capacity - 1)), &padding, sizeof(padding));
+                }
+
+                char* out = buffer.get() + ((position + skip) & (capacity - 1));
+                std::memcpy(out, &header, sizeof(header));
+                out += sizeof(header);
+
+                size_t left = header.captured;
+                for (int i = 0; i < count && left > 0; ++i) {
+                    const size_t n = std::min(left, parts[i].iov_len);
+                    std::memcpy(out, parts[i].iov_base, n);
+                    out += n;
+                    left -= n;
+                }
+
+                head.store(position + skip + need, std::memory_order_release);
+                return true;
+            }
+
+            // consumer; the next record, valid until pop()
+            const capture_record_header* peek() noexcept
+            {
+                while (true) {
+                    if (read_position == cached_head) {
+                        cached_head = head.load(std::memory_order_acquire);
+                        if (read_position == cached_head)
+                            return nullptr;
+                    }
+
+                    const size_t offset = read_position & (capacity - 1);
+                    const size_t to_end = capacity - offset;
+                    const auto* header = reinterpret_cast<const capture_record_header*>(buffer.get() + offset);
+                    if (to_end < sizeof(capture_record_header) || header->kind == capture_kind::padding) {
+                        read_position += to_end;
+                        tail.store(read_position, std::memory_order_release);
+                        continue;
+                    }
+                    return header;
+                }
+            }
+
+            void pop(const capture_record_header* header) noexcept
+            {
+                read_position += align(sizeof(*header) + header->captured);
+                tail.store(read_position, std::memory_order_release);
+            }
+
+            uint64_t dropped_record_count() const noexcept { return dropped_records.load(std::memory_order_relaxed); }
+            uint64_t dropped_byte_count() const noexcept { return dropped_bytes.load(std::memory_order_relaxed); }
+
+            // set once the owning thread is gone, the writer frees it when drained
+            std::atomic<bool> retired = false;
+
+        private:
+            static size_t align(size_t n) noexcept { return (n + 7) & ~size_t(7); }
+
+            std::unique_ptr<char[]> buffer;
+            size_t capacity;
+
+            alignas(64) std::atomic<size_t> head = 0;
+            size_t cached_tail = 0;
+            std::atomic<uint64_t> dropped_records = 0;
+            std::atomic<uint64_t> dropped_bytes = 0;
+
+            alignas(64) std::atomic<size_t> tail = 0;
+            size_t read_position = 0;
+            size_t cached_head = 0;
+    };
+
+    // Synthesizes raw IP packets around captured payloads, pcapng blocks
+    // around those.
+    class pcapng_writer
+    {
+        public:
+            explicit pcapng_writer(FILE* out) noexcept : file(out) {}
+
+            // pcapng is written in host byte order, readers go by the magic
+            void begin(uint32_t snap_length) noexcept
+            {
+                // section header: byte-order magic, version 1.0, unknown section length
+                const uint32_t shb[] = { 0x0A0D0D0A, 28, 0x1A2B3C4D, pair16(1, 0), 0xFFFFFFFF, 0xFFFFFFFF, 28 };
+                std::fwrite(shb, sizeof(shb), 1, file);
+
+                // interface: LINKTYPE_RAW, nanosecond timestamps (if_tsresol = 9)
+                const uint8_t tsresol[4] = { 9, 0, 0, 0 };
+                uint32_t resolution;
+                std::memcpy(&resolution, tsresol, 4);
+                const uint32_t idb[] = { 0x00000001, 32, pair16(101, 0), snap_length, pair16(9, 1), resolution, 0, 32 };
+                std::fwrite(idb, sizeof(idb), 1, file);
+            }
+
+            void add_connection(uint32_t id, const capture_connection_record& record) noexcept
+            {
+                connection& conn = connections[id];
+                conn.stream = record.type == SOCK_STREAM;
+                conn.v6 = to_endpoint(record.local, conn.local) | to_endpoint(record.peer, conn.peer);
+                if (conn.v6) {
+                    to_v6(conn.local);
+                    to_v6(conn.peer);
+                }
+                if (conn.local.family == 0 && conn.peer.family == 0) {
+                    // not IP, made up so tools can tell connections apart
+                    conn.local = { AF_INET, { 127, 0, 0, 1 }, 0 };
+                    conn.peer = { AF_INET, { 127, 0, 0, 2 }, static_cast<uint16_t>(id) };
+                }
+            }
+
+            void add_payload(const capture_record_header& header, const char* payload) noexcept
+            {
+                auto found = connections.find(header.connection);
+                if (found == connections.end())
+                    return;
+
+                connection& conn = found->second;
+                const bool sent = header.kind == capture_kind::sent;
+                const endpoint& source = sent ? conn.local : conn.peer;
+                const endpoint& destination = sent ? conn.peer : conn.local;
+
+                // large sends become several segments so every length fits in 16 bits
+                constexpr static size_t max_segment = 65000;
+                size_t offset = 0;
+                do {
+                    const size_t original = std::min<size_t>(header.original - offset, max_segment);
+                    const size_t captured = offset < header.captured ? std::min<size_t>(header.captured - offset, original) : 0;
+
+                    uint32_t& seq = conn.seq[sent ? 0 : 1];
+                    const uint32_t ack = conn.seq[sent ? 1 : 0];
+                    write_packet(conn, source, destination, seq, ack, payload + offset, captured, original, header.timestamp_ns);
+                    if (conn.stream)
+                        seq += original;
+
+                    offset += original;
+                } while (offset < header.original);
+            }
+
+        private:
+            struct endpoint
+            {
+                int family;
+                uint8_t address[16];
+                uint16_t port;
+            };
+
+            struct connection
+            {
+                bool stream;
+                bool v6;
+                endpoint local;
+                endpoint peer;
+                uint32_t seq[2] = { 1, 1 };     // sent, received
+            };
+
+            // true when only IPv6 can express it; IPv4-mapped addresses are unmapped
+            static bool to_endpoint(const sockaddr_storage& address, endpoint& out) noexcept
+            {
+                out = {};
+                if (address.ss_family == AF_INET) {
+                    const auto& in = reinterpret_cast<const sockaddr_in&>(address);
+                    out.family = AF_INET;
+                    std::memcpy(out.address, &in.sin_addr, 4);
+                    out.port = ntohs(in.sin_port);
+                } else if (address.ss_family == AF_INET6) {
+                    const auto& in6 = reinterpret_cast<const sockaddr_in6&>(address);
+                    out.port = ntohs(in6.sin6_port);
+                    if (IN6_IS_ADDR_V4MAPPED(&in6.sin6_addr)) {
+                        out.family = AF_INET;
+                        std::memcpy(out.address, in6.sin6_addr.s6_addr + 12, 4);
+                    } else {
+                        out.family = AF_INET6;
+                        std::memcpy(out.address, in6.sin6_addr.s6_addr, 16);
+                        return true;
+                    }
+                }
+                return false;
+            }
+
+            static void to_v6(endpoint& e) noexcept
+            {
+                if (e.family == AF_INET) {
+                    uint8_t v4[4];
+                    std::memcpy(v4, e.address, 4);
+                    std::memset(e.address, 0, 16);
+                    e.address[10] = e.address[11] = 0xff;
+                    std::memcpy(e.address + 12, v4, 4);
+                }
+                e.family = AF_INET6;
+            }
+
+            static uint32_t pair16(uint16_t first, uint16_t second) noexcept
+            {
+                const uint16_t both[2] = { first, second };
+                uint32_t rval;
+                std::memcpy(&rval, both, 4);
+                return rval;
+            }
+
+            static void put16(char*& out, uint16_t v) noexcept { v = htons(v); std::memcpy(out, &v, 2); out += 2; }
+            static void put32(char*& out, uint32_t v) noexcept { v = htonl(v); std::memcpy(out, &v, 4); out += 4; }
+
+            static uint16_t ipv4_checksum(const char* header) noexcept
+            {
+                uint32_t sum = 0;
+                for (int i = 0; i < 20; i += 2)
+                    sum += (uint8_t(header[i]) << 8) | uint8_t(header[i + 1]);
+                while (sum >> 16)
+                    sum = (sum & 0xffff) + (sum >> 16);
+                return static_cast<uint16_t>(~sum);
+            }
+
+            void write_packet(const connection& conn, const endpoint& source, const endpoint& destination,
+                              uint32_t seq, uint32_t ack, const char* payload, size_t captured, size_t original,
+                              uint64_t timestamp_ns) noexcept
+            {
+                char headers[60];
+                char* out = headers;
+
+                const size_t transport_size = conn.stream ? 20 : 8;
+                const size_t transport_length = std::min<size_t>(transport_size + original, 0xffff);
+
+                if (conn.v6) {
+                    put32(out, 0x60000000);
+                    put16(out, static_cast<uint16_t>(transport_length));
+                    *out++ = conn.stream ? IPPROTO_TCP : IPPROTO_UDP;
+                    *out++ = 64;
+                    std::memcpy(out, source.address, 16); out += 16;
+                    std::memcpy(out, destination.address, 16); out += 16;
+                } else {
+                    put16(out, 0x4500);
+                    put16(out, static_cast<uint16_t>(std::min<size_t>(20 + transport_length, 0xffff)));
+                    put32(out, 0x00004000);                     // id 0, don't fragment
+                    *out++ = 64;
+                    *out++ = conn.stream ? IPPROTO_TCP : IPPROTO_UDP;
+                    put16(out, 0);
+                    std::memcpy(out, source.address, 4); out += 4;
+                    std::memcpy(out, destination.address, 4); out += 4;
+
+                    const uint16_t checksum = htons(ipv4_checksum(headers));
+                    std::memcpy(headers + 10, &checksum, 2);
+                }
+
+                put16(out, source.port);
+                put16(out, destination.port);
+                if (conn.stream) {
+                    put32(out, seq);
+                    put32(out, ack);
+                    put16(out, 0x5018);                         // 20 byte header, PSH|ACK
+                    put16(out, 0xffff);
+                    put32(out, 0);
+                } else {
+                    put16(out, static_cast<uint16_t>(transport_length));
+                    put16(out, 0);
+                }
+
+                const uint32_t header_size = static_cast<uint32_t>(out - headers);
+                const uint32_t captured_length = header_size + static_cast<uint32_t>(captured);
+                const uint32_t padding = (4 - captured_length % 4) % 4;
+                const uint32_t block_length = 32 + captured_length + padding;
+
+                const uint32_t epb[] = {
+                    0x00000006, block_length, 0,
+                    static_cast<uint32_t>(timestamp_ns >> 32), static_cast<uint32_t>(timestamp_ns),
+                    captured_length, header_size + static_cast<uint32_t>(original)
+                };
+                const uint32_t zero = 0;
+
+                std::fwrite(epb, sizeof(epb), 1, file);
+                std::fwrite(headers, header_size, 1, file);
+                std::fwrite(payload, captured, 1, file);
+                std::fwrite(&zero, padding, 1, file);
+                std::fwrite(&block_length, sizeof(block_length), 1, file);
+            }
+
+            FILE* file;
+            std::unordered_map<uint32_t, connection> connections;
+    };
+
+    // Owns the rings, the options of the running capture and its writer.
+    class capture_engine
+    {
+        public:
+            static capture_engine& instance() noexcept
+            {
+                static capture_engine engine;
+                return engine;
+            }
+
+            ~capture_engine() { stop(); }
+
+            tl::expected<void, error_code> start(capture_opts opts) noexcept
+            {
+                std::lock_guard guard(lock);
+                if (writer.joinable())
+                    return tl::unexpected(error_code::capture_failed);
+
+                FILE* out = std::fopen(opts.path.c_str(), "wb");
+                if (out == nullptr)
+                    return tl::unexpected(error_code::capture_failed);
+                std::setvbuf(out, nullptr, _IOFBF, 1 << 20);
+
+                file = out;
+                options = std::make_shared<const capture_opts>(std::move(opts));
+                totals = {};
+                dropped_baseline = dropped_locked();
+                running = true;
+
+                if (options->format == capture_format::binary)
+                    std::fwrite("UNETCAP1", 8, 1, file);
+                else
+                    pcapng_writer(file).begin(options->payload_limit + 60);
+
+                limit.store(options->payload_limit, std::memory_order_relaxed);
+
+                writer = std::thread([this, session = ++sessions] { run(session); });
+                capture_session.store(sessions, std::memory_order_release);
+                return {};
+            }
+
+            capture_stats stop() noexcept
+            {
+                std::thread stopping;
+                {
+                    std::lock_guard guard(lock);
+                    if (not writer.joinable())
+                        return totals;
+
+                    capture_session.store(0, std::memory_order_release);
+                    running = false;
+                    stopping = std::move(writer);
+                }
+                wake.notify_all();
+                stopping.join();
+
+                std::lock_guard guard(lock);
+                std::fclose(file);
+                file = nullptr;
+                totals.dropped_records = dropped_locked().dropped_records - dropped_baseline.dropped_records;
+                totals.dropped_bytes = dropped_locked().dropped_bytes - dropped_baseline.dropped_bytes;
+                free_retired();
+                return totals;
+            }
+
+            capture_stats info() noexcept
+            {
+                std::lock_guard guard(lock);
+                capture_stats rval;
+                rval.connections = std::atomic_ref(totals.connections).load(std::memory_order_relaxed);
+                rval.records = std::atomic_ref(totals.records).load(std::memory_order_relaxed);
+                rval.bytes = std::atomic_ref(totals.bytes).load(std::memory_order_relaxed);
+                rval.dropped_records = totals.dropped_records;
+                rval.dropped_bytes = totals.dropped_bytes;
+                if (writer.joinable()) {
+                    const capture_stats dropped = dropped_locked();
+                    rval.dropped_records = dropped.dropped_records - dropped_baseline.dropped_records;
+                    rval.dropped_bytes = dropped.dropped_bytes - dropped_baseline.dropped_bytes;
+                }
+                return rval;
+            }
+
+            std::shared_ptr<const capture_opts> current_options() noexcept
+            {
+                std::lock_guard guard(lock);
+                return options;
+            }
+
+            capture_ring* attach() noexcept
+            {
+                std::lock_guard guard(lock);
+                const size_t bytes = options ? options->ring_bytes : capture_opts{}.ring_bytes;
+
+                auto* ring = new (std::nothrow) capture_ring(bytes);
+                if (ring == nullptr || not ring->valid()) {
+                    delete ring;
+                    return nullptr;
+                }
+                rings.push_back(ring);
+                return ring;
+            }
+
+            void retire(capture_ring* ring) noexcept
+            {
+                std::lock_guard guard(lock);
+                ring->retired.store(true, std::memory_order_release);
+                if (not writer.joinable())
+                    free_retired();
+            }
+
+            uint32_t payload_limit() const noexcept { return limit.load(std::memory_order_relaxed); }
+
+        private:
+            capture_engine() noexcept = default;
+
+            void run(uint32_t session) noexcept
+            {
+                pcapng_writer pcapng(file);
+                while (true) {
+                    bool stopping;
+                    {
+                        std::lock_guard guard(lock);
+                        stopping = not running;
+                    }
+
+                    const size_t written = drain(session, pcapng);
+                    if (stopping)
+                        break;
+
+                    if (written == 0) {
+                        std::unique_lock guard(lock);
+                        wake.wait_for(guard, options->flush_interval, [&] { return not running; });
+                        std::fflush(file);
+                    }
+                }
+                std::fflush(file);
+            }
+
+            // merges what the rings hold by timestamp, up to a bound so a
+            // busy producer can't keep the writer from checking for stop
+            size_t drain(uint32_t session, pcapng_writer& pcapng) noexcept
+            {
+                std::vector<capture_ring*> snapshot;
+                std::vector<bool> was_retired;
+                {
+                    std::lock_guard guard(lock);
+                    snapshot = rings;
+                }
+                for (capture_ring* ring : snapshot)
+                    was_retired.push_back(ring->retired.load(std::memory_order_acquire));
+
+                std::vector<const capture_record_header*> next(snapshot.size());
+                for (size_t i = 0; i < snapshot.size(); ++i)
+                    next[i] = snapshot[i]->peek();
+
+                size_t written = 0;
+                for (; written < 65536; ++written) {
+                    size_t oldest = snapshot.size();
+                    for (size_t i = 0; i < snapshot.size(); ++i)
+                        if (next[i] && (oldest == snapshot.size() || next[i]->timestamp_ns < next[oldest]->timestamp_ns))
+                            oldest = i;
+                    if (oldest == snapshot.size())
+                        break;
+
+                    emit(session, *next[oldest], pcapng);
+                    snapshot[oldest]->pop(next[oldest]);
+                    next[oldest] = snapshot[oldest]->peek();
+                }
+
+                // rings of exited threads go once empty
+                bool any_done = false;
+                for (size_t i = 0; i < snapshot.size(); ++i)
+                    any_done |= was_retired[i] && next[i] == nullptr;
+                if (any_done) {
+                    std::lock_guard guard(lock);
+                    for (size_t i = 0; i < snapshot.size(); ++i) {
+                        if (was_retired[i] && next[i] == nullptr)
+                            release(snapshot[i]);
+                    }
+                }
+                return written;
+            }
+
+            void emit(uint32_t session, const capture_record_header& header, pcapng_writer& pcapng) noexcept
+            {
+                if (header.session != session)
+                    return;     // left over from an earlier capture
+
+                const char* payload = reinterpret_cast<const char*>(&header + 1);
+                if (options->format == capture_format::binary) {
+                    std::fwrite(&header, sizeof(header), 1, file);
+                    std::fwrite(payload, header.captured, 1, file);
+                }
+
+                if (header.kind == capture_kind::connection) {
+                    if (options->format == capture_format::pcapng) {
+                        capture_connection_record record;
+                        std::memcpy(&record, payload, sizeof(record));
+                        pcapng.add_connection(header.connection, record);
+                    }
+                    bump(totals.connections, 1);
+                } else {
+                    if (options->format == capture_format::pcapng)
+                        pcapng.add_payload(header, payload);
+                    bump(totals.records, 1);
+                    bump(totals.bytes, header.captured);
+                }
+            }
+
+            // only the writer writes totals, info() may read them meanwhile
+            static void bump(uint64_t& counter, uint64_t value) noexcept {
+                std::atomic_ref(counter).store(counter + value, std::memory_order_relaxed);
+            }
+
+            capture_stats dropped_locked() const noexcept
+            {
+                capture_stats rval = retired_dropped;
+                for (const capture_ring* ring : rings) {
+                    rval.dropped_records += ring->dropped_record_count();
+                    rval.dropped_bytes += ring->dropped_byte_count();
+                }
+                return rval;
+            }
+
+            void release(capture_ring* ring) noexcept
+            {
+                retired_dropped.dropped_records += ring->dropped_record_count();
+                retired_dropped.dropped_bytes += ring->dropped_byte_count();
+                rings.erase(std::remove(rings.begin(), rings.end(), ring), rings.end());
+                delete ring;
+            }
+
+            void free_retired() noexcept
+            {
+                std::vector<capture_ring*> done;
+                for (capture_ring* ring : rings)
+                    if (ring->retired.load(std::memory_order_acquire))
+                        done.push_back(ring);
+                for (capture_ring* ring : done)
+                    release(ring);
+            }
+
+            std::mutex lock;
+            std::condition_variable wake;
+            std::thread writer;
+            bool running = false;
+
+            FILE* file = nullptr;
+            std::shared_ptr<const capture_opts> options;
+            std::atomic<uint32_t> limit = 0;
+            uint32_t sessions = 0;
+
+            std::vector<capture_ring*> rings;
+            capture_stats totals;
+            capture_stats dropped_baseline;
+            capture_stats retired_dropped;
+    };
+
+    struct capture_thread_ring
+    {
+        capture_ring* ring = nullptr;
+        ~capture_thread_ring() { if (ring) capture_engine::instance().retire(ring); }
+    };
+
+    inline capture_ring* thread_capture_ring() noexcept
+    {
+        thread_local capture_thread_ring holder;
+        if (holder.ring == nullptr)
+            holder.ring = capture_engine::instance().attach();
+        return holder.ring;
+    }
+
+    template <>
+    class capture_tap<true>
+    {
+        public:
+            capture_tap() noexcept = default;
+
+            // between quiescent sockets, when one is moved into another
+            capture_tap(const capture_tap& other) noexcept { *this = other; }
+            capture_tap& operator=(const capture_tap& other) noexcept
+            {
+                decision.store(other.decision.load(std::memory_order_relaxed), std::memory_order_relaxed);
+                mode.store(other.mode.load(std::memory_order_relaxed), std::memory_order_relaxed);
+                return *this;
+            }
+
+            void sent(native_socket_type fd, int type, const void* data, size_t size) noexcept
+            {
+                const iovec part{ const_cast<void*>(data), size };
+                record(fd, type, capture_kind::sent, &part, 1, size);
+            }
+
+            // the first `size` bytes of a gathered write
+            void sent(native_socket_type fd, int type, const iovec* parts, int count, size_t size) noexcept {
+                record(fd, type, capture_kind::sent, parts, count, size);
+            }
+
+            void received(native_socket_type fd, int type, const void* data, size_t size) noexcept
+            {
+                const iovec part{ const_cast<void*>(data), size };
+                record(fd, type, capture_kind::received, &part, 1, size);
+            }
+
+            // overrides sampling and the filter, for the running capture and later ones
+            void force(bool enabled) noexcept
+            {
+                mode.store(enabled ? forced_on : forced_off, std::memory_order_relaxed);
+                decision.store(0, std::memory_order_release);
+            }
+
+            // for a closed or moved-from socket: whatever it carries next is a
+            // new connection, with its own id and sampling decision
+            void reset() noexcept { decision.store(0, std::memory_order_release); }
+
+        private:
+            enum : uint8_t { sampled, forced_on, forced_off };
+
+            // The decision is one word, the session it was made for, the
+            // connection id and whether it is captured, so the threads
+            // sending and receiving on a socket agree on it.  The first to
+            // see a new session claims it with id 0 and the rest wait the
+            // few microseconds until it is published, by which time the
+            // connection record is in a ring ahead of their payloads.
+            static uint64_t packed(uint32_t session, uint32_t id, bool chosen) noexcept {
+                return uint64_t(session) << 32 | uint64_t(id) << 1 | uint64_t(chosen);
+            }
+            static uint32_t session_of(uint64_t d) noexcept { return uint32_t(d >> 32); }
+            static uint32_t id_of(uint64_t d) noexcept { return uint32_t(d) >> 1; }
+            static bool chosen_of(uint64_t d) noexcept { return d & 1; }
+
+            void record(native_socket_type fd, int type, capture_kind kind, const iovec* parts, int count, size_t size) noexcept
+            {
+                const uint32_t current = capture_session.load(std::memory_order_relaxed);
+                if (current == 0)
+                    return;
+
+                uint64_t seen = decision.load(std::memory_order_acquire);
+                while (session_of(seen) != current || id_of(seen) == 0) {
+                    if (session_of(seen) == current) {
+                        std::this_thread::yield();
+                        seen = decision.load(std::memory_order_acquire);
+                    } else if (decision.compare_exchange_weak(seen, packed(current, 0, false), std::memory_order_acquire)) {
+                        seen = decide(fd, type, current);
+                        break;
+                    }
+                }
+                if (not chosen_of(seen))
+                    return;
+
+                capture_ring* ring = thread_capture_ring();
+                if (ring == nullptr)
+                    return;
+
+                capture_record_header header{};
+                header.timestamp_ns = capture_now_ns();
+                header.session = current;
+                header.connection = id_of(seen);
+                header.original = static_cast<uint32_t>(std::min<size_t>(size, UINT32_MAX));
+                header.captured = static_cast<uint32_t>(std::min<size_t>({ size, capture_engine::instance().payload_limit(), ring->max_payload() }));
+                header.kind = kind;
+                ring->push(header, parts, count);
+            }
+
+            // only ever run by the thread that claimed the session, returns
+            // the decision and publishes it unless a reset came in between
+            uint64_t decide(native_socket_type fd, int type, uint32_t current) noexcept
+            {
+                static std::atomic<uint32_t> ids = 0;
+
+                // ids fit in 31 bits next to the flag, 0 marks a claim
+                const uint32_t id = ids.fetch_add(1, std::memory_order_relaxed) % 0x7fffffffu + 1;
+                const uint8_t how = mode.load(std::memory_order_relaxed);
+                bool chosen = how == forced_on;
+
+                auto options = capture_engine::instance().current_options();
+                if (how != forced_off && options != nullptr)
+                {
+                    capture_connection conn{ id, type, {}, {} };
+                    socklen_t size = sizeof(conn.local);
+                    ::getsockname(fd, reinterpret_cast<sockaddr*>(&conn.local), &size);
+                    size = sizeof(conn.peer);
+                    if (::getpeername(fd, reinterpret_cast<sockaddr*>(&conn.peer), &size) == -1)
+                        conn.peer = {};
+
+                    if (how == sampled) {
+                        chosen = (id - 1) % std::max<uint32_t>(options->sample_one_in, 1) == 0;
+                        if (chosen && options->filter)
+                            chosen = options->filter(conn);
+                    }
+
+                    capture_ring* ring = chosen ? thread_capture_ring() : nullptr;
+                    if (ring != nullptr) {
+                        const capture_connection_record record{ type, 0, conn.local, conn.peer };
+                        const iovec part{ const_cast<capture_connection_record*>(&record), sizeof(record) };
+
+                        capture_record_header header{};
+                        header.timestamp_ns = capture_now_ns();
+                        header.session = current;
+                        header.connection = id;
+                        header.captured = header.original = sizeof(record);
+                        header.kind = capture_kind::connection;
+
+                        // without it the writer can't place the payloads, try again next time
+                        if (not ring->push(header, &part, 1)) {
+                            uint64_t claim = packed(current, 0, false);
+                            decision.compare_exchange_strong(claim, 0, std::memory_order_release, std::memory_order_relaxed);
+                            return packed(current, id, false);
+                        }
+                    }
+                }
+
+                const uint64_t made = packed(current, id, chosen);
+                uint64_t claim = packed(current, 0, false);
+                decision.compare_exchange_strong(claim, made, std::memory_order_release, std::memory_order_relaxed);
+                return made;
+            }
+
+            std::atomic<uint64_t> decision = 0;
+            std::atomic<uint8_t> mode = sampled;
+    };
+}
+
+namespace unet
+{
+    inline tl::expected<void, error_code> start_capture(capture_opts opts) noexcept
+    {
+        return detail::capture_engine::instance().start(std::move(opts));
+    }
+
+    inline capture_stats stop_capture() noexcept
+    {
+        return detail::capture_engine::instance().stop();
+    }
+
+    inline capture_stats capture_info() noexcept
+    {
+        return detail::capture_engine::instance().info();
+    }
+}
+
+#endif
@@ -0,0 +1,378 @@
+#ifndef UNET_CONNECTION_POOL_HPP
+#define UNET_CONNECTION_POOL_HPP
+
+// Client-side pool of connected sockets keyed by host:port, so repeated
+// calls to the same backend skip name resolution, the handshake and slow
+// start:
+//
+//     unet::connection_pool<unet::tcp_connection> pool;
+//     auto conn = pool.acquire("10.0.0.7", 8080);
+//     conn->send(request);
+//     ...                     // back to the pool when `conn` goes away
+//
+// Idle connections sit in a fixed array of atomic slots per endpoint and
+// endpoints in an insert-only open-addressed table, so acquire() and the
+// return are a handful of atomic exchanges without locks.  Each thread
+// starts its slot scan at its own offset to keep threads off each other's
+// cache lines.
+
+#include "basic_socket.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+
+namespace unet
+{
+    struct pool_opts
+    {
+        size_t max_idle = 16;           // per endpoint, returns beyond this are closed
+        size_t max_total = 64;          // per endpoint, idle and checked out
+        size_t max_endpoints = 256;     // distinct host:port pairs, rounded up to a power of two
+        std::chrono::milliseconds idle_ttl{30s};
+    };
+
+    struct pool_stats
+    {
+        uint64_t connects   = 0;    // new connections made
+        uint64_t reuses     = 0;    // idle connections handed out again
+        uint64_t stale      = 0;    // idle connections the peer had closed or written to
+        uint64_t expired    = 0;    // idle longer than idle_ttl
+        uint64_t overflows  = 0;    // returns closed because max_idle were idle
+        uint64_t exhausted  = 0;    // acquire() failures at max_total
+    };
+
+    template <typename Socket>
+    class connection_pool;
+
+    // A checked out connection, returned to its pool on destruction.  The
+    // pool must outlive it.
+    template <typename Socket>
+    class pooled_connection
+    {
+        public:
+            pooled_connection() noexcept = default;
+            pooled_connection(const pooled_connection&) = delete;
+            pooled_connection(pooled_connection&& other) noexcept
+                : pool(std::exchange(other.pool, nullptr)), item(std::exchange(other.item, nullptr)) {}
+            pooled_connection& operator=(pooled_connection other) noexcept {
+                std::swap(pool, other.pool);
+                std::swap(item, other.item);
+                return *this;
+            }
+            ~pooled_connection() { release(); }
+
+            Socket& operator*() const noexcept { return item->sock; }
+            Socket* operator->() const noexcept { return &item->sock; }
+            explicit operator bool() const noexcept { return item != nullptr; }
+
+            // returns the connection early; a closed one is dropped, and one
+            // with unread data fails the liveness check on the next acquire()
+            void release() noexcept {
+                if (item)
+                    std::exchange(pool, nullptr)->give_back(std::exchange(item, nullptr));
+            }
+
+            // closes instead of returning, after a protocol error for example
+            void discard() noexcept {
+                if (item)
+                    std::exchange(pool, nullptr)->drop(std::exchange(item, nullptr));
+            }
+
+        private:
+            friend class connection_pool<Socket>;
+            using item_type = typename connection_pool<Socket>::item;
+
+            pooled_connection(connection_pool<Socket>* p, item_type* i) noexcept : pool(p), item(i) {}
+
+            connection_pool<Socket>* pool = nullptr;
+            item_type* item = nullptr;
+    };
+
+    template <typename Socket>
+    class connection_pool
+    {
+        public:
+            explicit connection_pool(pool_opts opts = {});
+            connection_pool(const connection_pool&) = delete;
+            ~connection_pool();
+
+            // an idle connection that passes the liveness check, or a new one
+            tl::expected<pooled_connection<Socket>, error_code> acquire(const std::string& host, uint16_t port) noexcept;
+
+            // closes connections idle for longer than idle_ttl, for a timer to
+            // call; acquire() also skips them, this just frees the fds sooner
+            size_t evict_expired() noexcept;
+
+            pool_stats stats() const noexcept;
+
+        private:
+            friend class pooled_connection<Socket>;
+            using clock = std::chrono::steady_clock;
+
+            struct endpoint;
+
+            struct item
+            {
+                Socket sock;
+                endpoint* owner;
+                clock::time_point idle_since;
+            };
+
+            struct endpoint
+            {
+                endpoint(std::string h, uint16_t p, size_t slots)
+                    : host(std::move(h)), port(p), idle(std::make_unique<std::atomic<item*>[]>(slots)) {}
+
+                const std::string host;
+                const uint16_t port;
+                std::unique_ptr<std::atomic<item*>[]> idle;
+
+                alignas(64) std::atomic<size_t> total = 0;
+                std::atomic<uint64_t> connects = 0;
+                std::atomic<uint64_t> reuses = 0;
+                std::atomic<uint64_t> stale = 0;
+                std::atomic<uint64_t> expired = 0;
+                std::atomic<uint64_t> overflows = 0;
+                std::atomic<uint64_t> exhausted = 0;
+            };
+
+            endpoint* find_or_add(const std::string& host, uint16_t port) noexcept;
+            tl::expected<item*, error_code> connect_new(endpoint& ep) noexcept;
+
+            void give_back(item* it) noexcept;
+            void drop(item* it) noexcept;
+
+            // into any free slot, closed when all max_idle are taken
+            void give_back_idle(endpoint& ep, item* it) noexcept;
+
+            // per thread, so concurrent scans start on different slots
+            static size_t scan_start() noexcept {
+                static thread_local const size_t start = std::hash<std::thread::id>{}(std::this_thread::get_id());
+                return start;
+            }
+
+            pool_opts options;
+            size_t endpoint_mask;
+            std::unique_ptr<std::atomic<endpoint*>[]> endpoints;
+    };
+}
+
+namespace unet
+{
+    template <typename Socket>
+    connection_pool<Socket>::connection_pool(pool_opts opts)
+        : options(opts)
+    {
+        size_t capacity = 1;
+        while (capacity < options.max_endpoints)
+            capacity <<= 1;
+
+        endpoint_mask = capacity - 1;
+        endpoints = std::make_unique<std::atomic<endpoint*>[]>(capacity);
+    }
+
+    template <typename Socket>
+    connection_pool<Socket>::~connection_pool()
+    {
+        for (size_t i = 0; i <= endpoint_mask; ++i) {
+            endpoint* ep = endpoints[i].load(std::memory_order_acquire);
+            if (ep == nullptr)
+                continue;
+
+            for (size_t slot = 0; slot < options.max_idle; ++slot)
+                delete ep->idle[slot].exchange(nullptr, std::memory_order_acquire);
+            delete ep;
+        }
+    }
+
+    template <typename Socket>
+    tl::expected<pooled_connection<Socket>, error_code> connection_pool<Socket>::acquire(const std::string& host, uint16_t port) noexcept
+    {
+        endpoint* ep = find_or_add(host, port);
+        if (ep == nullptr)
+            return tl::unexpected(error_code::pool_exhausted);
+
+        const size_t start = scan_start();
+        const clock::time_point now = clock::now();
+
+        for (size_t i = 0; i < options.max_idle; ++i) {
+            std::atomic<item*>& slot = ep->idle[(start + i) % options.max_idle];
+            if (slot.load(std::memory_order_relaxed) == nullptr)
+                continue;
+
+            item* it = slot.exchange(nullptr, std::memory_order_acquire);
+            if (it == nullptr)
+                continue;
+
+            if (now - it->idle_since > options.idle_ttl) {
+                ep->expired.fetch_add(1, std::memory_order_relaxed);
+                drop(it);
+                continue;
+            }
+            if (not it->sock.is_reusable()) {
+                ep->stale.fetch_add(1, std::memory_order_relaxed);
+                drop(it);
+                continue;
+            }
+
+            ep->reuses.fetch_add(1, std::memory_order_relaxed);
+            return pooled_connection<Socket>(this, it);
+        }
+
+        auto created = connect_new(*ep);
+        if (not created.has_value())
+            return tl::unexpected(created.error());
+        return pooled_connection<Socket>(this, created.value());
+    }
+
+    template <typename Socket>
+    size_t connection_pool<Socket>::evict_expired() noexcept
+    {
+        const clock::time_point now = clock::now();
+        size_t evicted = 0;
+
+        for (size_t i = 0; i <= endpoint_mask; ++i) {
+            endpoint* ep = endpoints[i].load(std::memory_order_acquire);
+            if (ep == nullptr)
+                continue;
+
+            for (size_t slot = 0; slot < options.max_idle; ++slot) {
+                item* it = ep->idle[slot].exchange(nullptr, std::memory_order_acquire);
+                if (it == nullptr)
+                    continue;
+
+                if (now - it->idle_since > options.idle_ttl) {
+                    ep->expired.fetch_add(1, std::memory_order_relaxed);
+                    drop(it);
+                    evicted++;
+                } else {
+                    give_back_idle(*ep, it);
+                }
+            }
+        }
+        return evicted;
+    }
+
+    template <typename Socket>
+    pool_stats connection_pool<Socket>::stats() const noexcept
+    {
+        pool_stats rval;
+        for (size_t i = 0; i <= endpoint_mask; ++i) {
+            const endpoint* ep = endpoints[i].load(std::memory_order_acquire);
+            if (ep == nullptr)
+                continue;
+
+            rval.connects  += ep->connects.load(std::memory_order_relaxed);
+            rval.reuses    += ep->reuses.load(std::memory_order_relaxed);
+            rval.stale     += ep->stale.load(std::memory_order_relaxed);
+            rval.expired   += ep->expired.load(std::memory_order_relaxed);
+            rval.overflows += ep->overflows.load(std::memory_order_relaxed);
+            rval.exhausted += ep->exhausted.load(std::memory_order_relaxed);
+        }
+        return rval;
+    }
+
+    // Linear probing over an insert-only table: a slot, once set, never
+    // changes, so lookups need nothing but acquire loads.
+    template <typename Socket>
+    typename connection_pool<Socket>::endpoint* connection_pool<Socket>::find_or_add(const std::string& host, uint16_t port) noexcept
+    {
+        const size_t hash = std::hash<std::string_view>{}(host) * 31 + port;
+        endpoint* added = nullptr;
+
+        for (size_t probe = 0; probe <= endpoint_mask; ++probe) {
+            std::atomic<endpoint*>& slot = endpoints[(hash + probe) & endpoint_mask];
+
+            endpoint* ep = slot.load(std::memory_order_acquire);
+            if (ep == nullptr) {
+                if (added == nullptr) {
+                    added = new (std::nothrow) endpoint(host, port, options.max_idle);
+                    if (added == nullptr)
+                        return nullptr;
+                }
+                if (slot.compare_exchange_strong(ep, added, std::memory_order_acq_rel, std::memory_order_acquire))
+                    return added;
+                // lost the race, `ep` is the winner
+            }
+
+            if (ep->port == port && ep->host == host) {
+                delete added;
+                return ep;
+            }
+        }
+
+        delete added;
+        return nullptr;
+    }
+
+    template <typename Socket>
+    tl::expected<typename connection_pool<Socket>::item*, error_code> connection_pool<Socket>::connect_new(endpoint& ep) noexcept
+    {
+        size_t total = ep.total.load(std::memory_order_relaxed);
+        do {
+            if (total >= options.max_total) {
+                ep.exhausted.fetch_add(1, std::memory_order_relaxed);
+                return tl::unexpected(error_code::pool_exhausted);
+            }
+        } while (not ep.total.compare_exchange_weak(total, total + 1, std::memory_order_relaxed));
+
+        item* it = new (std::nothrow) item{ Socket{}, &ep, {} };
+        if (it == nullptr) {
+            ep.total.fetch_sub(1, std::memory_order_relaxed);
+            return tl::unexpected(error_code::pool_exhausted);
+        }
+
+        auto connected = it->sock.connect(ep.host, ep.port);
+        if (not connected.has_value()) {
+            drop(it);
+            return tl::unexpected(connected.error());
+        }
+
+        ep.connects.fetch_add(1, std::memory_order_relaxed);
+        return it;
+    }
+
+    template <typename Socket>
+    void connection_pool<Socket>::give_back(item* it) noexcept
+    {
+        if (not it->sock.is_active()) {
+            drop(it);
+            return;
+        }
+
+        it->idle_since = clock::now();
+        give_back_idle(*it->owner, it);
+    }
+
+    template <typename Socket>
+    void connection_pool<Socket>::give_back_idle(endpoint& ep, item* it) noexcept
+    {
+        const size_t start = scan_start();
+        for (size_t i = 0; i < options.max_idle; ++i) {
+            std::atomic<item*>& slot = ep.idle[(start + i) % options.max_idle];
+
+            item* empty = nullptr;
+            if (slot.load(std::memory_order_relaxed) == nullptr
+                && slot.compare_exchange_strong(empty, it, std::memory_order_release, std::memory_order_relaxed))
+                return;
+        }
+
+        ep.overflows.fetch_add(1, std::memory_order_relaxed);
+        drop(it);
+    }
+
+    template <typename Socket>
+    void connection_pool<Socket>::drop(item* it) noexcept
+    {
+        it->owner->total.fetch_sub(1, std::memory_order_relaxed);
+        delete it;
+    }
+}
+
+#endif
@@ -0,0 +1,197 @@
+#ifndef UNET_CONNECTION_TABLE_HPP
+#define UNET_CONNECTION_TABLE_HPP
+
+#include <cstdint>
+#include <span>
+#include <utility>
+#include <vector>
+
+#if defined(UNET_EPOLL)
+# include <sys/epoll.h>
+#endif
+
+namespace unet
+{
+    // Generational handle into a connection_table.  Packs into the 64 bits
+    // of epoll_event.data.u64, a handle whose slot has since been reused
+    // no longer matches and lookups reject it.
+    struct connection_handle
+    {
+        uint32_t index = 0;
+        uint32_t generation = 0;    // 0 is never handed out
+
+        constexpr uint64_t to_u64() const noexcept {
+            return (uint64_t(generation) << 32) | index;
+        }
+
+        constexpr static connection_handle from_u64(uint64_t value) noexcept {
+            return { static_cast<uint32_t>(value), static_cast<uint32_t>(value >> 32) };
+        }
+
+        constexpr bool is_valid() const noexcept { return generation != 0; }
+
+        constexpr bool operator==(const connection_handle&) const = default;
+    };
+
+    // Slot map for per-connection state.  Values live in one dense vector
+    // so sweeps (idle checks etc.) walk contiguous memory, handles map to
+    // them through a slot array without any hashing.
+    //
+    // Erasing moves the last value into the hole, so pointers/iteration
+    // positions are invalidated by erase() and insert(); handles are not.
+    template <typename T>
+    class connection_table
+    {
+        public:
+            using value_type = T;
+
+            template <typename... Args>
+            connection_handle emplace(Args&&... args);
+            connection_handle insert(T value) { return emplace(std::move(value)); }
+
+            bool erase(connection_handle handle) noexcept;
+
+            T* find(connection_handle handle) noexcept;
+            const T* find(connection_handle handle) const noexcept;
+
+            T* find(uint64_t packed) noexcept { return find(connection_handle::from_u64(packed)); }
+
+            bool contains(connection_handle handle) const noexcept { return find(handle) != nullptr; }
+
+            // handle of the value at a dense position, for erasing during sweeps
+            connection_handle handle_at(size_t position) const noexcept {
+                const uint32_t index = dense_to_slot[position];
+                return { index, slots[index].generation };
+            }
+
+            size_t size() const noexcept { return values.size(); }
+            bool empty() const noexcept { return values.empty(); }
+            void reserve(size_t count);
+            void clear() noexcept;
+
+            auto begin() noexcept { return values.begin(); }
+            auto end() noexcept { return values.end(); }
+            auto begin() const noexcept { return values.begin(); }
+            auto end() const noexcept { return values.end(); }
+
+            std::span<T> dense() noexcept { return values; }
+
+        private:
+            constexpr static uint32_t no_slot = UINT32_MAX;
+
+            struct slot
+            {
+                uint32_t position;      // dense position when live, next free slot otherwise
+                uint32_t generation;    // odd while live, even while free
+            };
+
+            const slot* live_slot(connection_handle handle) const noexcept
+            {
+                if (handle.index >= slots.size())
+                    return nullptr;
+
+                const slot& s = slots[handle.index];
+                return (s.generation == handle.generation && (s.generation & 1)) ? &s : nullptr;
+            }
+
+            std::vector<T> values;
+            std::vector<uint32_t> dense_to_slot;
+            std::vector<slot> slots;
+            uint32_t free_head = no_slot;
+    };
+
+    #if defined(UNET_EPOLL)
+    inline epoll_event make_epoll_event(connection_handle handle, uint32_t events) noexcept
+    {
+        epoll_event event{};
+        event.events = events;
+        event.data.u64 = handle.to_u64();
+        return event;
+    }
+
+    inline connection_handle handle_from_event(const epoll_event& event) noexcept
+    {
+        return connection_handle::from_u64(event.data.u64);
+    }
+    #endif
+}
+
+namespace unet
+{
+    template <typename T> template <typename... Args>
+    connection_handle connection_table<T>::emplace(Args&&... args)
+    {
+        values.emplace_back(std::forward<Args>(args)...);
+
+        uint32_t index;
+        if (free_head != no_slot) {
+            index = free_head;
+            free_head = slots[index].position;
+            slots[index].generation++;
+        } else {
+            index = static_cast<uint32_t>(slots.size());
+            slots.push_back({ 0, 1 });
+        }
+
+        slots[index].position = static_cast<uint32_t>(values.size() - 1);
+        dense_to_slot.push_back(index);
+
+        return { index, slots[index].generation };
+    }
+
+    template <typename T>
+    bool connection_table<T>::erase(connection_handle handle) noexcept
+    {
+        if (live_slot(handle) == nullptr)
+            return false;
+
+        slot& erased = slots[handle.index];
+        const uint32_t position = erased.position;
+        const uint32_t last = static_cast<uint32_t>(values.size() - 1);
+
+        if (position != last) {
+            values[position] = std::move(values[last]);
+            dense_to_slot[position] = dense_to_slot[last];
+            slots[dense_to_slot[position]].position = position;
+        }
+        values.pop_back();
+        dense_to_slot.pop_back();
+
+        erased.generation++;
+        erased.position = free_head;
+        free_head = handle.index;
+        return true;
+    }
+
+    template <typename T>
+    T* connection_table<T>::find(connection_handle handle) noexcept
+    {
+        const slot* s = live_slot(handle);
+        return s ? &values[s->position] : nullptr;
+    }
+
+    template <typename T>
+    const T* connection_table<T>::find(connection_handle handle) const noexcept
+    {
+        const slot* s = live_slot(handle);
+        return s ? &values[s->position] : nullptr;
+    }
+
+    template <typename T>
+    void connection_table<T>::reserve(size_t count)
+    {
+        values.reserve(count);
+        dense_to_slot.reserve(count);
+        slots.reserve(count);
+    }
+
+    template <typename T>
+    void connection_table<T>::clear() noexcept
+    {
+        // generations must survive so outstanding handles stay stale
+        while (not values.empty())
+            erase(handle_at(values.size() - 1));
+    }
+}
+
+#endif
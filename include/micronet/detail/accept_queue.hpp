@@ -0,0 +1,170 @@
+#ifndef UNET_INTERNAL_ACCEPT_QUEUE_HPP
+#define UNET_INTERNAL_ACCEPT_QUEUE_HPP
+
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__linux__) || defined(__linux)
+# include <fcntl.h>
+# include <netinet/in.h>
+# include <netinet/tcp.h>
+# include <sys/socket.h>
+# include <unistd.h>
+#endif
+
+namespace unet
+{
+    struct listen_opts
+    {
+        // 0 for the most the kernel allows, net.core.somaxconn on Linux;
+        // larger values are capped to that by the kernel anyway
+        int backlog = 0;
+
+        // TCP_DEFER_ACCEPT where the platform has it: accept() only sees a
+        // connection once its first data arrived, or after this long; not
+        // for protocols where the server speaks first
+        std::chrono::seconds defer_accept{0};
+    };
+
+    struct accept_queue_stats
+    {
+        size_t queued = 0;              // established, waiting for accept()
+        size_t backlog = 0;             // the queue length the kernel applies
+
+        // host-wide, from /proc/net/netstat: handshakes completed into a full
+        // queue, and every SYN or ACK a listener dropped
+        uint64_t listen_overflows = 0;
+        uint64_t listen_drops = 0;
+    };
+
+    // how shed_connections() gets rid of a connection: close() sends a FIN
+    // (or a RST if the peer's data is unread), reset always sends a RST
+    // through SO_LINGER 0 and leaves no TIME_WAIT behind
+    enum class shed_mode { close, reset };
+}
+
+namespace unet::detail
+{
+    inline int max_listen_backlog() noexcept
+    {
+        static const int backlog = [] {
+            int rval = SOMAXCONN;
+            #if defined(__linux__) || defined(__linux)
+            if (FILE* f = std::fopen("/proc/sys/net/core/somaxconn", "r")) {
+                if (std::fscanf(f, "%d", &rval) != 1 || rval <= 0)
+                    rval = SOMAXCONN;
+                std::fclose(f);
+            }
+            #endif
+            return rval;
+        }();
+        return backlog;
+    }
+
+    // best effort, false when the platform doesn't have it
+    template <typename NativeSocket>
+    bool set_defer_accept(NativeSocket fd, std::chrono::seconds timeout) noexcept
+    {
+        #if defined(TCP_DEFER_ACCEPT)
+        const int seconds = static_cast<int>(timeout.count());
+        return setsockopt(fd, IPPROTO_TCP, TCP_DEFER_ACCEPT, &seconds, sizeof(seconds)) == 0;
+        #else
+        (void)fd;
+        (void)timeout;
+        return false;
+        #endif
+    }
+
+    #if defined(__linux__) || defined(__linux)
+    // for a listener TCP_INFO reports the accept queue in tcpi_unacked and
+    // its limit in tcpi_sacked
+    inline bool add_accept_queue(int fd, accept_queue_stats& stats) noexcept
+    {
+        tcp_info info{};
+        socklen_t size = sizeof(info);
+        if (getsockopt(fd, IPPROTO_TCP, TCP_INFO, &info, &size) == -1)
+            return false;
+
+        stats.queued += info.tcpi_unacked;
+        stats.backlog += info.tcpi_sacked;
+        return true;
+    }
+
+    // TcpExt is a header line of names followed by a line of values
+    inline void read_listen_counters(accept_queue_stats& stats) noexcept
+    {
+        FILE* f = std::fopen("/proc/net/netstat", "r");
+        if (f == nullptr)
+            return;
+
+        char names[16384];
+        char values[16384];
+        while (std::fgets(names, sizeof(names), f) && std::fgets(values, sizeof(values), f))
+        {
+            if (std::strncmp(names, "TcpExt:", 7) != 0)
+                continue;
+
+            char* name_state = nullptr;
+            char* value_state = nullptr;
+            char* name = strtok_r(names, " \n", &name_state);
+            char* value = strtok_r(values, " \n", &value_state);
+            for (; name && value; name = strtok_r(nullptr, " \n", &name_state), value = strtok_r(nullptr, " \n", &value_state))
+            {
+                if (std::strcmp(name, "ListenOverflows") == 0)
+                    stats.listen_overflows = std::strtoull(value, nullptr, 10);
+                else if (std::strcmp(name, "ListenDrops") == 0)
+                    stats.listen_drops = std::strtoull(value, nullptr, 10);
+            }
+            break;
+        }
+        std::fclose(f);
+    }
+    #endif
+
+    template <typename NativeSocket>
+    void shed_accepted(NativeSocket fd, shed_mode mode) noexcept
+    {
+        if (mode == shed_mode::reset) {
+            const linger abort{ 1, 0 };
+            setsockopt(fd, SOL_SOCKET, SO_LINGER, reinterpret_cast<const char*>(&abort), sizeof(abort));
+        }
+        ::close(fd);
+    }
+
+    #if defined(__linux__) || defined(__linux)
+    // Accepts and sheds up to `limit` queued connections until accept4()
+    // reports the queue empty.  The listener is non-blocking meanwhile, so
+    // that takes no poll() per connection; an accept() racing with it on
+    // another thread could see EAGAIN, hence call it from the accepting one.
+    inline size_t shed_queued(int fd, size_t limit, shed_mode mode) noexcept
+    {
+        const int flags = fcntl(fd, F_GETFL);
+        const bool blocking = flags != -1 && (flags & O_NONBLOCK) == 0;
+        if (flags == -1 || (blocking && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == -1))
+            return 0;
+
+        size_t shed = 0;
+        while (shed < limit) {
+            const int accepted = ::accept4(fd, nullptr, nullptr, SOCK_CLOEXEC);
+            if (accepted == -1) {
+                // gone before we got to it, the next one may still be there
+                if (errno == ECONNABORTED || errno == EINTR)
+                    continue;
+                break;
+            }
+            shed_accepted(accepted, mode);
+            shed++;
+        }
+
+        if (blocking)
+            fcntl(fd, F_SETFL, flags);
+        return shed;
+    }
+    #endif
+}
+
+#endif
@@ -0,0 +1,70 @@
+#ifndef UNET_INTERNAL_BUSY_POLL_HPP
+#define UNET_INTERNAL_BUSY_POLL_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+
+#if defined(__linux__) || defined(__linux)
+# include <sys/socket.h>
+#endif
+
+namespace unet
+{
+    struct busy_poll_opts
+    {
+        // how long a blocking receive retries with MSG_DONTWAIT before it
+        // parks in the kernel, at most 65535us
+        std::chrono::microseconds spin_budget{50};
+
+        // also ask the kernel to poll the device queue (SO_BUSY_POLL and
+        // SO_PREFER_BUSY_POLL); raising it above net.core.busy_read needs
+        // CAP_NET_ADMIN, without it only the user-space spin is used
+        bool kernel_busy_poll = true;
+    };
+}
+
+namespace unet::detail
+{
+    using spin_clock = std::chrono::steady_clock;
+
+    // tells the core we're in a spin-wait loop, so a hyperthread sibling
+    // gets the pipeline and leaving the loop doesn't flush it
+    inline void cpu_relax() noexcept
+    {
+        #if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+        #elif defined(__aarch64__)
+        asm volatile("yield");
+        #endif
+    }
+
+    inline uint16_t spin_budget_us(std::chrono::microseconds budget) noexcept
+    {
+        return static_cast<uint16_t>(std::clamp<int64_t>(budget.count(), 0, UINT16_MAX));
+    }
+
+    // best effort, false when the kernel refused or doesn't know the options
+    template <typename NativeSocket>
+    bool set_kernel_busy_poll(NativeSocket fd, std::chrono::microseconds budget) noexcept
+    {
+        #if defined(SO_BUSY_POLL)
+        const int usecs = static_cast<int>(budget.count());
+        if (setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &usecs, sizeof(usecs)) == -1)
+            return false;
+
+        # if defined(SO_PREFER_BUSY_POLL)
+        const int prefer = usecs != 0;
+        if (setsockopt(fd, SOL_SOCKET, SO_PREFER_BUSY_POLL, &prefer, sizeof(prefer)) == -1)
+            return false;
+        # endif
+        return true;
+        #else
+        (void)fd;
+        (void)budget;
+        return false;
+        #endif
+    }
+}
+
+#endif
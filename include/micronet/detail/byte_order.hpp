@@ -0,0 +1,237 @@
+#ifndef UNET_INTERNAL_BYTE_ORDER_HPP
+#define UNET_INTERNAL_BYTE_ORDER_HPP
+
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <utility>
+
+#if defined(_MSC_VER)
+# include <stdlib.h>
+#endif
+
+#if defined(__SSE2__)
+# include <emmintrin.h>
+#endif
+#if defined(__SSSE3__)
+# include <tmmintrin.h>
+#endif
+#if defined(__AVX2__)
+# include <immintrin.h>
+#endif
+
+namespace unet
+{
+    // Field widths of a struct for send_array()/recv_array(), in declaration
+    // order, with padding bytes listed as 1:
+    //
+    //     struct sample {
+    //         uint32_t id; uint16_t port; uint16_t flags; double value;
+    //         constexpr static auto wire_layout = unet::wire_fields<4, 2, 2, 8>;
+    //     };
+    //
+    // Arithmetic types and enums are a single field and need none.
+    template <size_t... Widths>
+    constexpr std::array<uint8_t, sizeof...(Widths)> wire_fields{ static_cast<uint8_t>(Widths)... };
+
+    template <typename T, typename = int>
+    struct has_wire_layout : std::false_type {};
+
+    template <typename T>
+    struct has_wire_layout<T, decltype((void) T::wire_layout, 0)> : std::true_type {};
+
+    template <typename T>
+    concept wire_type = std::is_trivially_copyable_v<T>
+                        && (std::is_arithmetic_v<T> || std::is_enum_v<T> || has_wire_layout<T>::value);
+}
+
+namespace unet::detail
+{
+    template <wire_type T>
+    constexpr auto wire_layout_of() noexcept
+    {
+        if constexpr (has_wire_layout<T>::value)
+            return T::wire_layout;
+        else
+            return std::array<uint8_t, 1>{ sizeof(T) };
+    }
+
+    template <wire_type T>
+    constexpr bool valid_wire_layout() noexcept
+    {
+        size_t total = 0;
+        for (uint8_t width : wire_layout_of<T>()) {
+            if (width != 1 && width != 2 && width != 4 && width != 8)
+                return false;
+            total += width;
+        }
+        return total == sizeof(T);
+    }
+
+    // byte i of an element in network order is byte source[i] of the host one
+    template <wire_type T>
+    constexpr std::array<uint8_t, sizeof(T)> wire_permutation() noexcept
+    {
+        std::array<uint8_t, sizeof(T)> source{};
+        size_t offset = 0;
+        for (uint8_t width : wire_layout_of<T>()) {
+            for (size_t i = 0; i < width; ++i)
+                source[offset + i] = static_cast<uint8_t>(offset + width - 1 - i);
+            offset += width;
+        }
+        return source;
+    }
+
+    // 0 unless every field has the same width
+    template <wire_type T>
+    constexpr size_t uniform_field_width() noexcept
+    {
+        constexpr auto layout = wire_layout_of<T>();
+        for (uint8_t width : layout) {
+            if (width != layout[0])
+                return 0;
+        }
+        return layout[0];
+    }
+
+    // network order is big endian; on big-endian hosts, and for byte-only
+    // layouts, conversion is a no-op
+    template <wire_type T>
+    constexpr bool needs_byte_swap() noexcept
+    {
+        if constexpr (std::endian::native == std::endian::big)
+            return false;
+        else
+            return uniform_field_width<T>() != 1;
+    }
+
+    template <size_t Width>
+    inline void swap_field(const std::byte* in, std::byte* out) noexcept
+    {
+        if constexpr (Width == 1) {
+            *out = *in;
+        } else {
+            using word = std::conditional_t<Width == 2, uint16_t, std::conditional_t<Width == 4, uint32_t, uint64_t>>;
+            word v;
+            std::memcpy(&v, in, Width);
+            #if defined(_MSC_VER)
+            if constexpr (Width == 2) v = _byteswap_ushort(v);
+            else if constexpr (Width == 4) v = _byteswap_ulong(v);
+            else v = _byteswap_uint64(v);
+            #else
+            if constexpr (Width == 2) v = __builtin_bswap16(v);
+            else if constexpr (Width == 4) v = __builtin_bswap32(v);
+            else v = __builtin_bswap64(v);
+            #endif
+            std::memcpy(out, &v, Width);
+        }
+    }
+
+    template <wire_type T>
+    constexpr std::array<size_t, wire_layout_of<T>().size()> wire_offsets() noexcept
+    {
+        std::array<size_t, wire_layout_of<T>().size()> offsets{};
+        size_t offset = 0;
+        for (size_t i = 0; i < offsets.size(); ++i) {
+            offsets[i] = offset;
+            offset += wire_layout_of<T>()[i];
+        }
+        return offsets;
+    }
+
+    // one element, field by field, unrolled over the layout
+    template <wire_type T, size_t... Fields>
+    inline void swap_element(const std::byte* in, std::byte* out, std::index_sequence<Fields...>) noexcept
+    {
+        constexpr static auto layout = wire_layout_of<T>();
+        constexpr static auto offsets = wire_offsets<T>();
+
+        std::byte element[sizeof(T)];
+        std::memcpy(element, in, sizeof(T));
+        (swap_field<layout[Fields]>(element + offsets[Fields], out + offsets[Fields]), ...);
+    }
+
+    #if defined(__SSSE3__)
+    // the element permutation repeated over 16 bytes, for pshufb
+    template <wire_type T>
+    constexpr std::array<uint8_t, 16> wire_shuffle_mask() noexcept
+    {
+        constexpr auto source = wire_permutation<T>();
+        std::array<uint8_t, 16> mask{};
+        for (size_t i = 0; i < 16; ++i)
+            mask[i] = static_cast<uint8_t>(i - i % sizeof(T) + source[i % sizeof(T)]);
+        return mask;
+    }
+    #endif
+
+    #if defined(__SSE2__)
+    // reverses the bytes of every `Width`-byte lane
+    template <size_t Width>
+    inline __m128i swap_lanes(__m128i v) noexcept
+    {
+        if constexpr (Width == 8) {
+            v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(0, 1, 2, 3));
+            v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(0, 1, 2, 3));
+        } else if constexpr (Width == 4) {
+            v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+            v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+        }
+        return _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+    }
+    #endif
+
+    // Converts `count` elements between host and network order; `in` and
+    // `out` may be the same.  Element sizes dividing 16 go through pshufb
+    // (32 bytes at a time with AVX2) for any layout, or through SSE2 shifts
+    // when all fields have the same width; the rest is done per element.
+    template <wire_type T>
+    inline void swap_to_wire(const std::byte* in, std::byte* out, size_t count) noexcept
+    {
+        static_assert(valid_wire_layout<T>(), "wire_layout must list widths of 1, 2, 4 or 8 adding up to sizeof(T)");
+
+        if constexpr (not needs_byte_swap<T>()) {
+            if (in != out)
+                std::memmove(out, in, count * sizeof(T));
+            return;
+        } else {
+            const size_t total = count * sizeof(T);
+            size_t done = 0;
+
+            if constexpr (16 % sizeof(T) == 0) {
+                #if defined(__SSSE3__)
+                constexpr static auto mask_bytes = wire_shuffle_mask<T>();
+                const __m128i mask = _mm_loadu_si128(reinterpret_cast<const __m128i*>(mask_bytes.data()));
+
+                #if defined(__AVX2__)
+                const __m256i wide_mask = _mm256_broadcastsi128_si256(mask);
+                for (; done + 32 <= total; done += 32) {
+                    const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + done));
+                    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + done), _mm256_shuffle_epi8(v, wide_mask));
+                }
+                #endif
+
+                for (; done + 16 <= total; done += 16) {
+                    const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + done));
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + done), _mm_shuffle_epi8(v, mask));
+                }
+                #elif defined(__SSE2__)
+                if constexpr (uniform_field_width<T>() != 0) {
+                    for (; done + 16 <= total; done += 16) {
+                        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + done));
+                        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + done), swap_lanes<uniform_field_width<T>()>(v));
+                    }
+                }
+                #endif
+            }
+
+            constexpr static auto fields = std::make_index_sequence<wire_layout_of<T>().size()>{};
+            for (; done < total; done += sizeof(T))
+                swap_element<T>(in + done, out + done, fields);
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,151 @@
+#ifndef UNET_INTERNAL_DELIMITER_SCANNER_HPP
+#define UNET_INTERNAL_DELIMITER_SCANNER_HPP
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <span>
+
+#if defined(__SSE2__)
+# include <emmintrin.h>
+#endif
+
+namespace unet
+{
+    // a delimiter known at compile time, for `recv_until<"\r\n", T>()`
+    template <size_t N>
+    struct delimiter
+    {
+        constexpr delimiter(const char (&str)[N]) noexcept { std::copy_n(str, N, bytes); }
+
+        constexpr static size_t size() noexcept { return N - 1; }
+        constexpr uint8_t operator[](size_t i) const noexcept { return static_cast<uint8_t>(bytes[i]); }
+
+        char bytes[N]{};
+    };
+}
+
+namespace unet::detail
+{
+    constexpr static size_t no_match = SIZE_MAX;
+
+    // Scanner for a compile-time delimiter: memchr for a single byte, a
+    // first/last byte SSE2 filter for longer ones, with a Horspool loop for
+    // the tail and non-x86 targets.  Every table is built at compile time.
+    template <delimiter Delim>
+    struct static_scanner
+    {
+        static_assert(Delim.size() > 0, "empty delimiter");
+
+        constexpr static size_t size = Delim.size();
+
+        constexpr static uint8_t byte(size_t i) noexcept { return Delim[i]; }
+
+        // offset of the first match in data, or no_match
+        static size_t find(const uint8_t* data, size_t n) noexcept
+        {
+            if constexpr (size == 1) {
+                const void* hit = std::memchr(data, byte(0), n);
+                return hit ? static_cast<const uint8_t*>(hit) - data : no_match;
+            } else {
+                size_t i = 0;
+
+                #if defined(__SSE2__)
+                const __m128i first = _mm_set1_epi8(static_cast<char>(byte(0)));
+                const __m128i last = _mm_set1_epi8(static_cast<char>(byte(size - 1)));
+
+                for (; i + size - 1 + 16 <= n; i += 16) {
+                    const __m128i block_first = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+                    const __m128i block_last = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + size - 1));
+
+                    uint32_t candidates = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(first, block_first),
+                                                                          _mm_cmpeq_epi8(last, block_last)));
+                    while (candidates != 0) {
+                        const size_t at = i + std::countr_zero(candidates);
+                        if (matches_inner(data + at))
+                            return at;
+                        candidates &= candidates - 1;
+                    }
+                }
+                #endif
+
+                for (; i + size <= n; i += shift[data[i + size - 1]]) {
+                    if (data[i + size - 1] == byte(size - 1) && data[i] == byte(0) && matches_inner(data + i))
+                        return i;
+                }
+                return no_match;
+            }
+        }
+
+        private:
+            // the bytes between the first and the last one
+            static bool matches_inner(const uint8_t* at) noexcept
+            {
+                for (size_t k = 1; k + 1 < size; ++k)
+                    if (at[k] != byte(k))
+                        return false;
+                return true;
+            }
+
+            constexpr static std::array<uint8_t, 256> shift = [] {
+                std::array<uint8_t, 256> rval{};
+                rval.fill(static_cast<uint8_t>(std::min<size_t>(size, 255)));
+                for (size_t k = 0; k + 1 < size; ++k)
+                    rval[Delim[k]] = static_cast<uint8_t>(std::min<size_t>(size - 1 - k, 255));
+                return rval;
+            }();
+    };
+
+    // Same interface for a pattern only known at run time.
+    struct runtime_scanner
+    {
+        std::span<const uint8_t> pattern;
+        size_t size;
+
+        explicit runtime_scanner(std::span<const uint8_t> p) noexcept : pattern(p), size(p.size()) {}
+
+        uint8_t byte(size_t i) const noexcept { return pattern[i]; }
+
+        size_t find(const uint8_t* data, size_t n) const noexcept
+        {
+            for (size_t i = 0; i + size <= n; ++i) {
+                const void* hit = std::memchr(data + i, pattern[0], n - size + 1 - i);
+                if (hit == nullptr)
+                    return no_match;
+
+                i = static_cast<const uint8_t*>(hit) - data;
+                if (std::memcmp(data + i + 1, pattern.data() + 1, size - 1) == 0)
+                    return i;
+            }
+            return no_match;
+        }
+    };
+
+    // For a match that starts in `consumed` and finishes at the start of
+    // `data`: how many bytes of data complete it, 0 when there is none.
+    template <typename Scanner>
+    size_t straddling_match(const Scanner& scanner, std::span<const uint8_t> consumed, const uint8_t* data, size_t n) noexcept
+    {
+        const size_t longest = std::min(scanner.size - 1, consumed.size());
+
+        for (size_t k = longest; k > 0; --k) {
+            const size_t rest = scanner.size - k;
+            if (rest > n)
+                continue;
+
+            bool match = true;
+            for (size_t j = 0; match && j < k; ++j)
+                match = consumed[consumed.size() - k + j] == scanner.byte(j);
+            for (size_t j = 0; match && j < rest; ++j)
+                match = data[j] == scanner.byte(k + j);
+
+            if (match)
+                return rest;
+        }
+        return 0;
+    }
+}
+
+#endif
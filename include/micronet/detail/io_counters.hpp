@@ -0,0 +1,332 @@
+#ifndef UNET_INTERNAL_IO_COUNTERS_HPP
+#define UNET_INTERNAL_IO_COUNTERS_HPP
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+#include <algorithm>
+
+namespace unet
+{
+    struct io_counters
+    {
+        uint64_t bytes_sent     = 0;
+        uint64_t bytes_received = 0;
+        uint64_t send_calls     = 0;
+        uint64_t recv_calls     = 0;
+        uint64_t partial_sends  = 0;
+        uint64_t would_block    = 0;
+        uint64_t resets         = 0;    // ECONNRESET/EPIPE
+        uint64_t eofs           = 0;    // orderly shutdowns by the peer, a receive of 0 bytes
+        std::chrono::nanoseconds blocked_time{0};
+
+        // busy polling, see basic_socket::enable_busy_poll()
+        uint64_t spin_polls     = 0;    // MSG_DONTWAIT retries made while spinning
+        uint64_t spin_hits      = 0;    // receives satisfied within the spin budget
+        uint64_t parks          = 0;    // budget ran out, fell back to a blocking receive
+
+        io_counters& operator+=(const io_counters& rhs) noexcept
+        {
+            bytes_sent      += rhs.bytes_sent;
+            bytes_received  += rhs.bytes_received;
+            send_calls      += rhs.send_calls;
+            recv_calls      += rhs.recv_calls;
+            partial_sends   += rhs.partial_sends;
+            would_block     += rhs.would_block;
+            resets          += rhs.resets;
+            eofs            += rhs.eofs;
+            blocked_time    += rhs.blocked_time;
+            spin_polls      += rhs.spin_polls;
+            spin_hits       += rhs.spin_hits;
+            parks           += rhs.parks;
+            return *this;
+        }
+    };
+}
+
+namespace unet::detail
+{
+    // io_counters as relaxed atomics, for counters written by more than one
+    // thread: a socket's sender and receiver, or several concurrent senders
+    class atomic_io_counters
+    {
+        public:
+            atomic_io_counters() noexcept = default;
+            atomic_io_counters(const atomic_io_counters& other) noexcept { store(other.load()); }
+            atomic_io_counters& operator=(const atomic_io_counters& other) noexcept { store(other.load()); return *this; }
+
+            void add(const io_counters& delta) noexcept
+            {
+                apply(delta, [](std::atomic<uint64_t>& counter, uint64_t value) {
+                    counter.fetch_add(value, std::memory_order_relaxed);
+                });
+            }
+
+            io_counters load() const noexcept
+            {
+                io_counters rval;
+                rval.bytes_sent     = bytes_sent.load(std::memory_order_relaxed);
+                rval.bytes_received = bytes_received.load(std::memory_order_relaxed);
+                rval.send_calls     = send_calls.load(std::memory_order_relaxed);
+                rval.recv_calls     = recv_calls.load(std::memory_order_relaxed);
+                rval.partial_sends  = partial_sends.load(std::memory_order_relaxed);
+                rval.would_block    = would_block.load(std::memory_order_relaxed);
+                rval.resets         = resets.load(std::memory_order_relaxed);
+                rval.eofs           = eofs.load(std::memory_order_relaxed);
+                rval.blocked_time   = std::chrono::nanoseconds(blocked_ns.load(std::memory_order_relaxed));
+                rval.spin_polls     = spin_polls.load(std::memory_order_relaxed);
+                rval.spin_hits      = spin_hits.load(std::memory_order_relaxed);
+                rval.parks          = parks.load(std::memory_order_relaxed);
+                return rval;
+            }
+
+        protected:
+            template <typename Bump>
+            void apply(const io_counters& delta, Bump&& bump) noexcept
+            {
+                auto nonzero = [&](std::atomic<uint64_t>& counter, uint64_t value) {
+                    if (value != 0)
+                        bump(counter, value);
+                };
+                nonzero(bytes_sent, delta.bytes_sent);
+                nonzero(bytes_received, delta.bytes_received);
+                nonzero(send_calls, delta.send_calls);
+                nonzero(recv_calls, delta.recv_calls);
+                nonzero(partial_sends, delta.partial_sends);
+                nonzero(would_block, delta.would_block);
+                nonzero(resets, delta.resets);
+                nonzero(eofs, delta.eofs);
+                nonzero(blocked_ns, delta.blocked_time.count());
+                nonzero(spin_polls, delta.spin_polls);
+                nonzero(spin_hits, delta.spin_hits);
+                nonzero(parks, delta.parks);
+            }
+
+        private:
+            void store(const io_counters& value) noexcept
+            {
+                bytes_sent.store(value.bytes_sent, std::memory_order_relaxed);
+                bytes_received.store(value.bytes_received, std::memory_order_relaxed);
+                send_calls.store(value.send_calls, std::memory_order_relaxed);
+                recv_calls.store(value.recv_calls, std::memory_order_relaxed);
+                partial_sends.store(value.partial_sends, std::memory_order_relaxed);
+                would_block.store(value.would_block, std::memory_order_relaxed);
+                resets.store(value.resets, std::memory_order_relaxed);
+                eofs.store(value.eofs, std::memory_order_relaxed);
+                blocked_ns.store(value.blocked_time.count(), std::memory_order_relaxed);
+                spin_polls.store(value.spin_polls, std::memory_order_relaxed);
+                spin_hits.store(value.spin_hits, std::memory_order_relaxed);
+                parks.store(value.parks, std::memory_order_relaxed);
+            }
+
+            std::atomic<uint64_t> bytes_sent{0};
+            std::atomic<uint64_t> bytes_received{0};
+            std::atomic<uint64_t> send_calls{0};
+            std::atomic<uint64_t> recv_calls{0};
+            std::atomic<uint64_t> partial_sends{0};
+            std::atomic<uint64_t> would_block{0};
+            std::atomic<uint64_t> resets{0};
+            std::atomic<uint64_t> eofs{0};
+            std::atomic<uint64_t> blocked_ns{0};
+            std::atomic<uint64_t> spin_polls{0};
+            std::atomic<uint64_t> spin_hits{0};
+            std::atomic<uint64_t> parks{0};
+    };
+
+    // Counters of a single thread.  Only the owning thread writes, so plain
+    // relaxed load/store pairs are enough and no read-modify-write is needed.
+    class io_counter_shard : public atomic_io_counters
+    {
+        public:
+            io_counter_shard() noexcept;
+            io_counter_shard(const io_counter_shard&) = delete;
+            ~io_counter_shard();
+
+            void add(const io_counters& delta) noexcept
+            {
+                apply(delta, [](std::atomic<uint64_t>& counter, uint64_t value) {
+                    counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+                });
+            }
+    };
+
+    class io_counter_registry
+    {
+        public:
+            static io_counter_registry& instance() noexcept {
+                static io_counter_registry registry;
+                return registry;
+            }
+
+            void attach(io_counter_shard* shard) {
+                std::lock_guard guard(lock);
+                shards.push_back(shard);
+            }
+
+            // counts of exited threads are kept so the totals never go backwards
+            void detach(io_counter_shard* shard) {
+                std::lock_guard guard(lock);
+                retired += shard->load();
+                shards.erase(std::remove(shards.begin(), shards.end(), shard), shards.end());
+            }
+
+            io_counters snapshot() {
+                std::lock_guard guard(lock);
+                io_counters rval = retired;
+                for (const io_counter_shard* shard : shards)
+                    rval += shard->load();
+                return rval;
+            }
+
+        private:
+            std::mutex lock;
+            std::vector<io_counter_shard*> shards;
+            io_counters retired;
+    };
+
+    inline io_counter_shard::io_counter_shard() noexcept
+    {
+        io_counter_registry::instance().attach(this);
+    }
+
+    inline io_counter_shard::~io_counter_shard()
+    {
+        io_counter_registry::instance().detach(this);
+    }
+
+    inline io_counter_shard& thread_io_counters() noexcept
+    {
+        thread_local io_counter_shard shard;
+        return shard;
+    }
+
+    // Wraps the data path syscalls of a socket.  The disabled specialisation
+    // is empty and only forwards the call, so uninstrumented sockets pay
+    // nothing for it.
+    template <bool Enabled>
+    struct io_recorder
+    {
+        template <typename Syscall>
+        ssize_t sent(size_t, bool, Syscall&& call) noexcept { return call(); }
+
+        template <typename Syscall>
+        ssize_t received(bool, Syscall&& call, bool = true) noexcept { return call(); }
+
+        template <typename Wait>
+        auto waited(Wait&& wait) noexcept { return wait(); }
+
+        void spun(uint64_t, bool) noexcept {}
+    };
+
+    template <>
+    class io_recorder<true>
+    {
+        public:
+            using clock = std::chrono::steady_clock;
+
+            // a socket may send and receive on different threads
+            atomic_io_counters counters;
+
+            template <typename Syscall>
+            ssize_t sent(size_t requested, bool may_block, Syscall&& call) noexcept
+            {
+                const clock::time_point start = may_block ? clock::now() : clock::time_point{};
+                const ssize_t n = call();
+                const int saved_errno = errno;
+
+                io_counters delta;
+                delta.send_calls = 1;
+                if (n >= 0) {
+                    delta.bytes_sent = n;
+                    delta.partial_sends = size_t(n) < requested;
+                } else {
+                    classify_error(delta, saved_errno);
+                }
+                if (may_block)
+                    delta.blocked_time = clock::now() - start;
+
+                commit(delta);
+                errno = saved_errno;
+                return n;
+            }
+
+            // `consumes` is false for MSG_PEEK, whose bytes are counted when read for real
+            template <typename Syscall>
+            ssize_t received(bool may_block, Syscall&& call, bool consumes = true) noexcept
+            {
+                const clock::time_point start = may_block ? clock::now() : clock::time_point{};
+                const ssize_t n = call();
+                const int saved_errno = errno;
+
+                io_counters delta;
+                delta.recv_calls = 1;
+                if (n > 0)
+                    delta.bytes_received = consumes ? n : 0;
+                else if (n == 0)
+                    delta.eofs = 1;
+                else
+                    classify_error(delta, saved_errno);
+                if (may_block)
+                    delta.blocked_time = clock::now() - start;
+
+                commit(delta);
+                errno = saved_errno;
+                return n;
+            }
+
+            template <typename Wait>
+            auto waited(Wait&& wait) noexcept
+            {
+                const clock::time_point start = clock::now();
+                auto rval = wait();
+
+                io_counters delta;
+                delta.blocked_time = clock::now() - start;
+                commit(delta);
+                return rval;
+            }
+
+            // one busy-poll round of `polls` non-blocking receives
+            void spun(uint64_t polls, bool hit) noexcept
+            {
+                const int saved_errno = errno;
+
+                io_counters delta;
+                delta.spin_polls = polls;
+                delta.spin_hits = hit;
+                delta.parks = not hit;
+                commit(delta);
+                errno = saved_errno;
+            }
+
+        private:
+            static void classify_error(io_counters& delta, int err) noexcept
+            {
+                if (err == EAGAIN || err == EWOULDBLOCK)
+                    delta.would_block = 1;
+                else if (err == ECONNRESET || err == EPIPE)
+                    delta.resets = 1;
+            }
+
+            void commit(const io_counters& delta) noexcept
+            {
+                counters.add(delta);
+                thread_io_counters().add(delta);
+            }
+    };
+}
+
+namespace unet
+{
+    // Totals over all instrumented sockets of the process, summed from the
+    // per-thread shards.  Cheap enough to poll from a metrics endpoint.
+    inline io_counters global_io_counters() noexcept
+    {
+        return detail::io_counter_registry::instance().snapshot();
+    }
+}
+
+#endif
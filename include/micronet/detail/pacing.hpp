@@ -0,0 +1,344 @@
+#ifndef UNET_INTERNAL_PACING_HPP
+#define UNET_INTERNAL_PACING_HPP
+
+// Send pacing for socket types with `paced = true`.
+//
+// Streams hand their own rate to the kernel with SO_MAX_PACING_RATE, which
+// TCP honours by itself.  Datagrams (the kernel only paces those under
+// the fq qdisc, which a socket can't check for) and kernels that refuse
+// the option get a user-space limiter instead, as do pacing groups.
+//
+// The limiter is GCRA, a token bucket kept as a single "theoretical
+// arrival time", so a group shared by several threads is one CAS per send.
+// A datagram is admitted whole once the bucket is not in debt; the debt it
+// leaves delays the next one.  Streams are admitted a burst at a time, so
+// a large message is spread out rather than queued at the switch at once.
+//
+// A send the limiter holds back fails with rate_limited, or comes back
+// short once part of a stream went out, and pacing_timer() turns readable
+// when the rest would be admitted, so an event loop waits for it with the
+// socket.  Sleeping in send() instead is opt-in, for blocking code.
+
+#include "utility.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+#include <utility>
+
+#if defined(__linux__) || defined(__linux)
+# include <sys/socket.h>
+# include <sys/timerfd.h>
+# include <unistd.h>
+#endif
+
+namespace unet
+{
+    class pacing_group;
+}
+
+namespace unet::detail
+{
+    template <bool Paced>
+    class pacer {};
+}
+
+namespace unet
+{
+    struct pacing_opts
+    {
+        uint64_t bytes_per_second = 0;  // 0 for no limit of the socket's own, a group still applies
+        size_t burst_bytes = 0;         // 0 for 1ms worth, at least 3000 bytes
+        bool use_kernel = true;         // SO_MAX_PACING_RATE for stream sockets
+
+        // a send over the limit fails with error_code::rate_limited, or
+        // returns short after part of a stream, and pacing_timer() becomes
+        // readable once the rest would go through; true sleeps until then
+        bool wait = false;
+
+        pacing_group* group = nullptr;  // must outlive the socket
+    };
+
+    struct pacing_stats
+    {
+        bool kernel = false;                    // own rate enforced by SO_MAX_PACING_RATE
+        uint64_t bytes = 0;
+        uint64_t sends = 0;
+        uint64_t delayed_sends = 0;             // held back by the limiter
+        uint64_t rejected_sends = 0;            // rate_limited, without waiting
+        uint64_t total_delay_ns = 0;            // from the first attempt to admission
+        uint64_t max_delay_ns = 0;
+        double achieved_bytes_per_second = 0;   // since pacing was enabled
+    };
+}
+
+namespace unet::detail
+{
+    inline int64_t pacing_now_ns() noexcept
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // Generic cell rate algorithm over bytes.  `tat` is when the bucket
+    // would be full again; a send is admitted while that is at most `tau`
+    // (the burst) in the future.
+    class gcra
+    {
+        public:
+            gcra() noexcept = default;
+            gcra(uint64_t bytes_per_second, size_t burst_bytes) noexcept { configure(bytes_per_second, burst_bytes); }
+
+            void configure(uint64_t bytes_per_second, size_t burst_bytes) noexcept
+            {
+                ns_per_byte = bytes_per_second ? 1e9 / double(bytes_per_second) : 0;
+                burst = bytes_per_second == 0 ? 0 : burst_bytes ? burst_bytes : std::max<size_t>(bytes_per_second / 1000, 3000);
+                tau = static_cast<int64_t>(burst * ns_per_byte);
+                tat.store(0, std::memory_order_relaxed);
+            }
+
+            // what may go out back to back, 0 without a limit
+            size_t burst_bytes() const noexcept { return burst; }
+
+            // how long until a send would be admitted, without reserving
+            int64_t delay(int64_t now) const noexcept
+            {
+                const int64_t base = std::max(tat.load(std::memory_order_relaxed), now);
+                return std::max<int64_t>(base - tau - now, 0);
+            }
+
+            // 0 when admitted and accounted for, otherwise how long to wait
+            int64_t reserve(size_t bytes, int64_t now) noexcept
+            {
+                const int64_t cost = static_cast<int64_t>(bytes * ns_per_byte);
+                int64_t current = tat.load(std::memory_order_relaxed);
+                while (true) {
+                    const int64_t base = std::max(current, now);
+                    if (base - now > tau)
+                        return base - tau - now;
+                    if (tat.compare_exchange_weak(current, base + cost, std::memory_order_relaxed))
+                        return 0;
+                }
+            }
+
+        private:
+            std::atomic<int64_t> tat = 0;
+            double ns_per_byte = 0;
+            int64_t tau = 0;
+            size_t burst = 0;
+    };
+}
+
+namespace unet
+{
+    // An aggregate limit for several sockets, possibly on different threads
+    class pacing_group
+    {
+        public:
+            explicit pacing_group(uint64_t bytes_per_second, size_t burst_bytes = 0) noexcept
+                : limiter(bytes_per_second, burst_bytes), started(detail::pacing_now_ns()) {}
+
+            pacing_group(const pacing_group&) = delete;
+
+            uint64_t bytes() const noexcept { return sent.load(std::memory_order_relaxed); }
+
+            double achieved_bytes_per_second() const noexcept {
+                const int64_t elapsed = detail::pacing_now_ns() - started;
+                return elapsed > 0 ? bytes() * 1e9 / double(elapsed) : 0;
+            }
+
+        private:
+            template <bool> friend class detail::pacer;
+
+            detail::gcra limiter;
+            std::atomic<uint64_t> sent = 0;
+            int64_t started;
+    };
+}
+
+namespace unet::detail
+{
+    #if defined(__linux__) || defined(__linux)
+    template <>
+    class pacer<true>
+    {
+        public:
+            pacer() noexcept = default;
+            pacer(pacer&& other) noexcept { *this = std::move(other); }
+            pacer& operator=(pacer&& other) noexcept
+            {
+                close_timer();
+                active = std::exchange(other.active, false);
+                kernel = std::exchange(other.kernel, false);
+                wait = other.wait;
+                group = std::exchange(other.group, nullptr);
+                timer = std::exchange(other.timer, -1);
+                counters = other.counters;
+                started = other.started;
+                first_attempt = std::exchange(other.first_attempt, 0);
+                rate = other.rate;
+                burst = other.burst;
+                own.configure(kernel ? 0 : rate, burst);
+                other.own.configure(0, 0);
+                return *this;
+            }
+            ~pacer() { close_timer(); }
+
+            // true when the kernel paces the socket's own rate
+            bool enable(int fd, bool stream, const pacing_opts& opts) noexcept
+            {
+                active = true;
+                wait = opts.wait;
+                group = opts.group;
+                rate = opts.bytes_per_second;
+                burst = opts.burst_bytes;
+                counters = {};
+                started = pacing_now_ns();
+                first_attempt = 0;
+
+                kernel = stream && opts.use_kernel && rate != 0 && set_kernel_rate(fd, rate);
+                own.configure(kernel ? 0 : rate, burst);
+                return kernel;
+            }
+
+            void disable(int fd) noexcept
+            {
+                if (kernel && fd >= 0)
+                    set_kernel_rate(fd, ~uint64_t(0));
+                active = kernel = false;
+                group = nullptr;
+                own.configure(0, 0);
+                close_timer();
+            }
+
+            // how much of a stream to admit at a time: the smallest burst of
+            // the user-space limits that apply, 0 when there are none
+            size_t piece_size() const noexcept
+            {
+                if (not active)
+                    return 0;
+                size_t piece = own.burst_bytes();
+                if (group && group->limiter.burst_bytes() != 0 && (piece == 0 || group->limiter.burst_bytes() < piece))
+                    piece = group->limiter.burst_bytes();
+                return piece;
+            }
+
+            // before sending `bytes`; false when over the limit and not waiting
+            bool admit(size_t bytes) noexcept
+            {
+                if (not active)
+                    return true;
+
+                int64_t now = pacing_now_ns();
+                const int64_t attempt = first_attempt ? first_attempt : now;
+
+                while (true) {
+                    int64_t delay = own.delay(now);
+                    if (delay == 0 && group)
+                        delay = group->limiter.reserve(bytes, now);
+
+                    if (delay == 0) {
+                        own.reserve(bytes, now);
+                        account(bytes, now - attempt);
+                        return true;
+                    }
+
+                    if (not wait) {
+                        first_attempt = attempt;
+                        counters.rejected_sends++;
+                        arm_timer(now + delay);
+                        return false;
+                    }
+
+                    sleep_until(now + delay);
+                    now = pacing_now_ns();
+                }
+            }
+
+            // timerfd for event loops, readable once a rejected send would be admitted
+            tl::expected<int, error_code> timer_fd() noexcept
+            {
+                if (timer == -1)
+                    timer = ::timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+                if (timer == -1)
+                    return tl::unexpected(error_code::cannot_set_option);
+                return timer;
+            }
+
+            pacing_stats stats() const noexcept
+            {
+                pacing_stats rval = counters;
+                rval.kernel = kernel;
+                const int64_t elapsed = pacing_now_ns() - started;
+                rval.achieved_bytes_per_second = active && elapsed > 0 ? rval.bytes * 1e9 / double(elapsed) : 0;
+                return rval;
+            }
+
+        private:
+            void account(size_t bytes, int64_t delay) noexcept
+            {
+                counters.bytes += bytes;
+                counters.sends++;
+                if (delay > 0) {
+                    counters.delayed_sends++;
+                    counters.total_delay_ns += delay;
+                    counters.max_delay_ns = std::max<uint64_t>(counters.max_delay_ns, delay);
+                }
+                if (group)
+                    group->sent.fetch_add(bytes, std::memory_order_relaxed);
+                first_attempt = 0;
+            }
+
+            static bool set_kernel_rate(int fd, uint64_t bytes_per_second) noexcept
+            {
+                #if defined(SO_MAX_PACING_RATE)
+                // 64 bit rates since Linux 5.0, older kernels take 32 bits
+                if (setsockopt(fd, SOL_SOCKET, SO_MAX_PACING_RATE, &bytes_per_second, sizeof(bytes_per_second)) == 0)
+                    return true;
+                const uint32_t narrow = static_cast<uint32_t>(std::min<uint64_t>(bytes_per_second, UINT32_MAX));
+                return setsockopt(fd, SOL_SOCKET, SO_MAX_PACING_RATE, &narrow, sizeof(narrow)) == 0;
+                #else
+                (void)fd, (void)bytes_per_second;
+                return false;
+                #endif
+            }
+
+            static void sleep_until(int64_t deadline_ns) noexcept
+            {
+                const timespec deadline{ time_t(deadline_ns / 1'000'000'000), long(deadline_ns % 1'000'000'000) };
+                while (::clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, nullptr) == EINTR)
+                    ;
+            }
+
+            void arm_timer(int64_t deadline_ns) noexcept
+            {
+                if (timer_fd().has_value()) {
+                    const itimerspec when{ {}, { time_t(deadline_ns / 1'000'000'000), long(deadline_ns % 1'000'000'000) } };
+                    ::timerfd_settime(timer, TFD_TIMER_ABSTIME, &when, nullptr);
+                }
+            }
+
+            void close_timer() noexcept
+            {
+                if (timer != -1)
+                    ::close(timer);
+                timer = -1;
+            }
+
+            gcra own;
+            bool active = false;
+            bool kernel = false;
+            bool wait = false;
+            pacing_group* group = nullptr;
+            int timer = -1;
+            pacing_stats counters;
+            int64_t started = 0;
+            int64_t first_attempt = 0;
+            uint64_t rate = 0;
+            size_t burst = 0;
+    };
+    #endif
+}
+
+#endif
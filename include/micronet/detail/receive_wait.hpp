@@ -0,0 +1,73 @@
+#ifndef UNET_INTERNAL_RECEIVE_WAIT_HPP
+#define UNET_INTERNAL_RECEIVE_WAIT_HPP
+
+// How a blocking receive waits when it has a deadline or knows how much
+// it is waiting for.
+//
+// A deadline turns the receive non-blocking and does the waiting in
+// poll(), so it costs nothing unless the data isn't there yet, unlike
+// setting SO_RCVTIMEO before and after every call.  A stream read of a
+// known size waits for all of it in one MSG_WAITALL recv() when it has no
+// deadline.  With one it raises SO_RCVLOWAT to what it still needs while
+// it polls, and restores the previous value after, so poll() doesn't
+// report the socket readable for every segment of a large message.
+
+#include <chrono>
+#include <climits>
+#include <cstddef>
+
+#if defined(__linux__) || defined(__linux) || defined(__APPLE__) || defined(__FreeBSD__)
+# include <sys/socket.h>
+#endif
+
+namespace unet::detail
+{
+    using receive_clock = std::chrono::steady_clock;
+
+    constexpr receive_clock::time_point no_deadline{};
+
+    // below this a message is a segment or two, not worth two setsockopt() calls
+    constexpr size_t low_watermark_threshold = 8 * 1024;
+
+    // what a read asks for at most, half the default receive buffer
+    // (tcp_rmem); more makes the kernel grow the buffer and its window
+    // first, which stalls the sender for longer than the wakeups save
+    constexpr size_t low_watermark_limit = 64 * 1024;
+
+    template <typename NativeSocket>
+    bool set_receive_low_watermark(NativeSocket fd, size_t bytes) noexcept
+    {
+        #if defined(SO_RCVLOWAT)
+        const int value = static_cast<int>(bytes < size_t(INT_MAX / 2) ? bytes : INT_MAX / 2);
+        return setsockopt(fd, SOL_SOCKET, SO_RCVLOWAT, reinterpret_cast<const char*>(&value), sizeof(value)) == 0;
+        #else
+        (void)fd, (void)bytes;
+        return false;
+        #endif
+    }
+
+    // the current SO_RCVLOWAT, 0 when it can't be read
+    template <typename NativeSocket>
+    size_t receive_low_watermark(NativeSocket fd) noexcept
+    {
+        #if defined(SO_RCVLOWAT)
+        int value = 0;
+        socklen_t size = sizeof(value);
+        if (getsockopt(fd, SOL_SOCKET, SO_RCVLOWAT, reinterpret_cast<char*>(&value), &size) == 0 && value > 0)
+            return static_cast<size_t>(value);
+        #else
+        (void)fd;
+        #endif
+        return 0;
+    }
+
+    // what is left of the deadline for poll(), rounded up so the wait
+    // doesn't end just short of it and spin
+    inline std::chrono::milliseconds time_left(receive_clock::time_point deadline) noexcept
+    {
+        const auto left = deadline - receive_clock::now();
+        return left.count() > 0 ? std::chrono::ceil<std::chrono::milliseconds>(left) : std::chrono::milliseconds(0);
+    }
+}
+
+#endif
@@ -0,0 +1,218 @@
+#ifndef UNET_INTERNAL_SEND_QUEUE_HPP
+#define UNET_INTERNAL_SEND_QUEUE_HPP
+
+// Send path of socket types with `concurrent_send = true`.  Every send()
+// copies its message into a node and pushes it onto a lock-free stack.
+// The sender whose node lands on an empty stack leads that batch: it waits
+// for the current flusher to let go, takes the stack once, writes it in
+// push order with batched writev and lets go in turn, by which time the
+// next batch has a leader of its own.  The others return straight away.
+// Messages are written whole and in push order, so concurrent senders
+// can't interleave partial writes, and no send() writes more than the
+// one batch that piled up while it waited, at most max_queued_bytes.
+//
+// A successful send() means the message was queued, not that it was
+// written, unless it led its batch: it may still be waiting for the next
+// flush when send() returns.  A write error fails the leader only if its
+// own message wasn't written, drops the rest of that batch and fails the
+// sends that start after it.
+
+#include "utility.hpp"
+
+#include <atomic>
+#include <cstring>
+#include <new>
+#include <utility>
+
+#if defined(__linux__) || defined(__linux)
+# include <limits.h>
+# include <sys/uio.h>
+#endif
+
+namespace unet::detail
+{
+    template <bool Concurrent>
+    class send_queue {};
+
+    #if defined(__linux__) || defined(__linux)
+    template <>
+    class send_queue<true>
+    {
+        public:
+            // senders wait for the flusher beyond this many queued bytes
+            constexpr static size_t max_queued_bytes = 4 * 1024 * 1024;
+            constexpr static int max_batch = IOV_MAX < 256 ? IOV_MAX : 256;
+
+            send_queue() noexcept = default;
+
+            // only between quiescent sockets, nothing may be sending
+            send_queue(send_queue&& other) noexcept { *this = std::move(other); }
+            send_queue& operator=(send_queue&& other) noexcept
+            {
+                clear();
+                head.store(other.head.exchange(nullptr, std::memory_order_relaxed), std::memory_order_relaxed);
+                queued.store(other.queued.exchange(0, std::memory_order_relaxed), std::memory_order_relaxed);
+                broken.store(other.broken.exchange(false, std::memory_order_relaxed), std::memory_order_relaxed);
+                return *this;
+            }
+            ~send_queue() { clear(); }
+
+            // `write_batch(const iovec*, int count)` writes at least one byte
+            // or returns -1; it is only ever called by the flusher
+            template <typename WriteBatch>
+            tl::expected<size_t, error_code> send(const char* data, size_t size, WriteBatch&& write_batch) noexcept
+            {
+                if (broken.load(std::memory_order_acquire))
+                    return tl::unexpected(error_code::failed_to_send);
+                if (size == 0)
+                    return 0;
+
+                // backpressure; a full queue always has a leader waiting
+                // to flush it or a flusher writing it
+                size_t current = queued.load(std::memory_order_relaxed);
+                while (current >= max_queued_bytes) {
+                    queued.wait(current, std::memory_order_relaxed);
+                    current = queued.load(std::memory_order_relaxed);
+                    if (broken.load(std::memory_order_acquire))
+                        return tl::unexpected(error_code::failed_to_send);
+                }
+
+                node* message = static_cast<node*>(::operator new(sizeof(node) + size, std::nothrow));
+                if (message == nullptr)
+                    return tl::unexpected(error_code::failed_to_send);
+                message->size = size;
+                std::memcpy(message->data(), data, size);
+
+                queued.fetch_add(size, std::memory_order_relaxed);
+                node* below = head.load(std::memory_order_relaxed);
+                do {
+                    message->next = below;
+                } while (not head.compare_exchange_weak(below, message, std::memory_order_release, std::memory_order_relaxed));
+
+                // the batch's leader takes the stack with this node in it;
+                // the node may already be written and freed by now
+                if (below != nullptr)
+                    return size;
+
+                while (flushing.exchange(true, std::memory_order_acquire))
+                    flushing.wait(true, std::memory_order_relaxed);
+
+                const bool written = flush_once(write_batch);
+
+                flushing.store(false, std::memory_order_release);
+                flushing.notify_one();
+
+                if (not written)
+                    return tl::unexpected(error_code::failed_to_send);
+                return size;
+            }
+
+            size_t queued_bytes() const noexcept { return queued.load(std::memory_order_relaxed); }
+
+            // frees what a failed flush left behind and forgets the
+            // failure, so a socket reopened after close() can send again
+            void clear() noexcept
+            {
+                node* list = head.exchange(nullptr, std::memory_order_acquire);
+                while (list) {
+                    node* next = list->next;
+                    ::operator delete(list);
+                    list = next;
+                }
+                queued.store(0, std::memory_order_relaxed);
+                broken.store(false, std::memory_order_release);
+            }
+
+        private:
+            struct node
+            {
+                node* next;
+                size_t size;
+
+                char* data() noexcept { return reinterpret_cast<char*>(this + 1); }
+            };
+
+            // takes the stack once and writes it in push order, true when
+            // the oldest message, the leader's own, was written
+            template <typename WriteBatch>
+            bool flush_once(WriteBatch& write_batch) noexcept
+            {
+                node* list = head.exchange(nullptr, std::memory_order_acquire);
+
+                // pushed newest first
+                node* ordered = nullptr;
+                while (list) {
+                    node* next = list->next;
+                    list->next = ordered;
+                    ordered = list;
+                    list = next;
+                }
+
+                size_t written = 0;
+                while (ordered) {
+                    if (not broken.load(std::memory_order_relaxed) && write_some(ordered, written, write_batch))
+                        continue;
+
+                    broken.store(true, std::memory_order_release);
+                    size_t dropped = 0;
+                    while (ordered) {
+                        node* next = ordered->next;
+                        dropped += ordered->size;
+                        ::operator delete(ordered);
+                        ordered = next;
+                    }
+                    queued.fetch_sub(dropped, std::memory_order_relaxed);
+                    queued.notify_all();
+                }
+                return written != 0;
+            }
+
+            // writes up to max_batch messages from the front of `ordered`,
+            // frees the ones fully written, advances past and counts them
+            template <typename WriteBatch>
+            bool write_some(node*& ordered, size_t& written_messages, WriteBatch& write_batch) noexcept
+            {
+                iovec batch[max_batch];
+                int count = 0;
+                for (node* n = ordered; n != nullptr && count < max_batch; n = n->next)
+                    batch[count++] = { n->data(), n->size };
+
+                int first = 0;
+                while (first < count) {
+                    ssize_t written = write_batch(batch + first, count - first);
+                    if (written < 0)
+                        return false;
+
+                    size_t released = 0;
+                    while (first < count && size_t(written) >= batch[first].iov_len) {
+                        written -= batch[first].iov_len;
+                        released += ordered->size;
+
+                        node* next = ordered->next;
+                        ::operator delete(ordered);
+                        ordered = next;
+                        first++;
+                        written_messages++;
+                    }
+                    if (written > 0) {
+                        batch[first].iov_base = static_cast<char*>(batch[first].iov_base) + written;
+                        batch[first].iov_len -= written;
+                    }
+
+                    if (released) {
+                        queued.fetch_sub(released, std::memory_order_relaxed);
+                        queued.notify_all();
+                    }
+                }
+                return true;
+            }
+
+            alignas(64) std::atomic<node*> head = nullptr;
+            std::atomic<size_t> queued = 0;
+            alignas(64) std::atomic<bool> flushing = false;
+            std::atomic<bool> broken = false;
+    };
+    #endif
+}
+
+#endif
@@ -0,0 +1,307 @@
+#ifndef UNET_INTERNAL_SOCKET_STORAGE_HPP
+#define UNET_INTERNAL_SOCKET_STORAGE_HPP
+
+// How a basic_socket holds its OS sockets.
+//
+// dual_stack_storage keeps separate IPv4 and IPv6 sockets plus the
+// multiplexer used to accept on both, single_socket_storage keeps exactly
+// one socket and listens on a dual-stack IPv6 socket (IPV6_V6ONLY=0).
+
+#include "utility.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+
+namespace unet
+{
+    struct ip_socket_pair
+    {
+        os_socket_type ipv4;
+        os_socket_type ipv6;
+    };
+}
+
+namespace unet::detail
+{
+    // binds (empty host) or connects to the first usable address of `family`
+    inline os_socket_type open_os_socket(const std::string& host, uint16_t port, int family, int socktype, bool v6only) noexcept
+    {
+        addrinfo    hints{};
+        addrinfo*   server_info = nullptr;
+        addrinfo*   info = nullptr;
+
+        const int yes = 1;
+        const int ipv6_only = v6only;
+
+        char portstr[6]; sprintf(portstr, "%d", port);
+
+        hints.ai_family = family;
+        hints.ai_socktype = socktype;
+
+        if (host.empty()) {
+            hints.ai_flags = AI_PASSIVE;
+        }
+
+        if (getaddrinfo(host.empty() ? nullptr : host.c_str(), portstr, &hints, &server_info) != 0)
+            return os::disabled_socket;
+
+        native_socket_type socket_fd;
+
+        for (info = server_info; info != nullptr; info = info->ai_next)
+        {
+            if ((socket_fd = ::socket(info->ai_family, info->ai_socktype, info->ai_protocol)) == os::socket_error)
+                continue;
+
+            if (info->ai_family == AF_INET6)
+            {
+                if (setsockopt(socket_fd, IPPROTO_IPV6, IPV6_V6ONLY, reinterpret_cast<const char*>(&ipv6_only), sizeof(int)) == os::socket_error)
+                {
+                    freeaddrinfo(server_info);
+                    return os::disabled_socket;
+                }
+            }
+            if (setsockopt(socket_fd, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&yes), sizeof(int)) == os::socket_error)
+            {
+                freeaddrinfo(server_info);
+                return os::disabled_socket;
+            }
+
+            if (host.empty())
+            {
+                if (::bind(socket_fd, info->ai_addr, info->ai_addrlen) == os::socket_error)
+                {
+                    ::close(socket_fd);
+                    continue;
+                }
+            } else {
+                if (::connect(socket_fd, info->ai_addr, info->ai_addrlen) == os::socket_error)
+                {
+                    ::close(socket_fd);
+                    continue;
+                }
+            }
+            break;
+        }
+
+        freeaddrinfo(server_info);
+        if (info == nullptr)
+            return os::disabled_socket;
+
+        return socket_fd;
+    }
+
+    class dual_stack_storage : protected os::socket
+    {
+        public:
+            ip_socket_pair native_sockets() const noexcept {
+                return {
+                    socket_ipv4,
+                    socket_ipv6
+                };
+            }
+
+            // the one carrying data once connected or accepted
+            native_socket_type native_socket() const noexcept { return active_socket(); }
+
+        protected:
+            constexpr static bool single_socket = false;
+
+            dual_stack_storage() = default;
+
+            // the sockets themselves are handed over by take_sockets()
+            dual_stack_storage(dual_stack_storage&& other) noexcept : os::socket(std::move(other)) {}
+
+            bool has_active_socket() const noexcept { return (socket_ipv4 > 0) || (socket_ipv6 > 0); }
+
+            native_socket_type active_socket() const noexcept {
+                return static_cast<native_socket_type>(socket_ipv4 == os::disabled_socket ? socket_ipv6 : socket_ipv4);
+            }
+
+            bool same_sockets(const dual_stack_storage& other) const noexcept {
+                return (socket_ipv4 == other.socket_ipv4) && (socket_ipv6 == other.socket_ipv6);
+            }
+
+            void adopt_socket(os_socket_type socket_fd, int family) noexcept
+            {
+                socket_ipv4 = family == AF_INET ? socket_fd : os::disabled_socket;
+                socket_ipv6 = family == AF_INET6 ? socket_fd : os::disabled_socket;
+            }
+
+            void take_sockets(dual_stack_storage& other) noexcept
+            {
+                socket_ipv6 = other.socket_ipv6;
+                socket_ipv4 = other.socket_ipv4;
+
+                other.socket_ipv6 = other.socket_ipv6 == os::disabled_socket ? os::disabled_socket : os::uninitialised_socket;
+                other.socket_ipv4 = other.socket_ipv4 == os::disabled_socket ? os::disabled_socket : os::uninitialised_socket;
+            }
+
+            void close_sockets() noexcept
+            {
+                if (socket_ipv6 > 0)
+                    ::close(socket_ipv6);
+                if (socket_ipv4 > 0)
+                    ::close(socket_ipv4);
+
+                socket_ipv6 = socket_ipv6 == os::disabled_socket ? os::disabled_socket : os::uninitialised_socket;
+                socket_ipv4 = socket_ipv4 == os::disabled_socket ? os::disabled_socket : os::uninitialised_socket;
+            }
+
+            tl::expected<void, error_code> open_sockets(const std::string& host, uint16_t port, int socktype) noexcept
+            {
+                if ((socket_ipv6 > 0) || (socket_ipv4 > 0))
+                    return tl::unexpected(error_code::socket_already_open);
+
+                if (host.empty())
+                {
+                    socket_ipv6 = open_os_socket(host, port, AF_INET6, socktype, true);
+                    socket_ipv4 = open_os_socket(host, port, AF_INET, socktype, true);
+                } else {
+                    socket_ipv6 = open_os_socket(host, port, AF_INET6, socktype, true);
+                    if (socket_ipv6 > 0)
+                        socket_ipv4 = os::disabled_socket;
+                    else
+                        socket_ipv4 = open_os_socket(host, port, AF_INET, socktype, true);
+                }
+
+                if ((socket_ipv6 >= 0) || (socket_ipv4 >= 0))
+                    return {};
+
+                return tl::unexpected(host.empty() ? error_code::cannot_open_socket : error_code::cannot_connect);
+            }
+
+            tl::expected<void, error_code> listen_sockets(int backlog_size) noexcept
+            {
+                if (socket_ipv4 > 0)
+                {
+                    auto status = listen_on_os_socket(socket_ipv4, backlog_size, AF_INET);
+                    if (not status.has_value()) {
+                        ::close(socket_ipv4);
+                        socket_ipv4 = os::disabled_socket;
+                        return status;
+                    }
+                }
+
+                if (socket_ipv6 > 0)
+                {
+                    auto status = listen_on_os_socket(socket_ipv6, backlog_size, AF_INET6);
+                    if (not status.has_value()) {
+                        ::close(socket_ipv6);
+                        socket_ipv6 = os::disabled_socket;
+                        return status;
+                    }
+                }
+                return {};
+            }
+
+            template <typename Fn>
+            void for_each_socket(Fn&& fn) const noexcept
+            {
+                if (socket_ipv4 > 0)
+                    fn(static_cast<native_socket_type>(socket_ipv4));
+                if (socket_ipv6 > 0)
+                    fn(static_cast<native_socket_type>(socket_ipv6));
+            }
+
+            // returns the listening socket that has a connection pending
+            tl::expected<native_socket_type, error_code> wait_for_connection(std::chrono::milliseconds timeout) noexcept
+            {
+                os::platform_event_type event;
+                if (wait_listen(&event, 1, timeout) == -1)
+                    return tl::unexpected(error_code::no_socket_to_accept);
+
+                return native_socket_from_event(event);
+            }
+
+            // TODO/FIXME: this probably needs to be changed later on to be dependant on SocketType,
+            // e.g. we don't need IP sockets for UNIX domain sockets.
+            os_socket_type socket_ipv6 = os::uninitialised_socket;
+            os_socket_type socket_ipv4 = os::uninitialised_socket;
+    };
+
+    class single_socket_storage
+    {
+        public:
+            native_socket_type native_socket() const noexcept { return active_socket(); }
+
+        protected:
+            constexpr static bool single_socket = true;
+
+            single_socket_storage() = default;
+            single_socket_storage(single_socket_storage&&) noexcept {}
+
+            bool has_active_socket() const noexcept { return socket_fd > 0; }
+
+            native_socket_type active_socket() const noexcept {
+                return static_cast<native_socket_type>(socket_fd);
+            }
+
+            bool same_sockets(const single_socket_storage& other) const noexcept {
+                return socket_fd == other.socket_fd;
+            }
+
+            void adopt_socket(os_socket_type in_socket_fd, int) noexcept { socket_fd = in_socket_fd; }
+
+            void take_sockets(single_socket_storage& other) noexcept
+            {
+                socket_fd = other.socket_fd;
+                other.socket_fd = os::uninitialised_socket;
+            }
+
+            void close_sockets() noexcept
+            {
+                if (socket_fd > 0)
+                    ::close(socket_fd);
+                socket_fd = os::uninitialised_socket;
+            }
+
+            tl::expected<void, error_code> open_sockets(const std::string& host, uint16_t port, int socktype) noexcept
+            {
+                if (socket_fd > 0)
+                    return tl::unexpected(error_code::socket_already_open);
+
+                if (host.empty())
+                {
+                    // one IPv6 socket accepting IPv4 as mapped addresses, IPv4 only if there is no IPv6
+                    socket_fd = open_os_socket(host, port, AF_INET6, socktype, false);
+                    if (not (socket_fd > 0))
+                        socket_fd = open_os_socket(host, port, AF_INET, socktype, false);
+                } else {
+                    socket_fd = open_os_socket(host, port, AF_UNSPEC, socktype, false);
+                }
+
+                if (socket_fd > 0)
+                    return {};
+
+                return tl::unexpected(host.empty() ? error_code::cannot_open_socket : error_code::cannot_connect);
+            }
+
+            tl::expected<void, error_code> listen_sockets(int backlog_size) noexcept
+            {
+                if (::listen(socket_fd, backlog_size) == -1)
+                    return tl::unexpected(error_code::cannot_listen);
+                return {};
+            }
+
+            template <typename Fn>
+            void for_each_socket(Fn&& fn) const noexcept
+            {
+                if (socket_fd > 0)
+                    fn(active_socket());
+            }
+
+            tl::expected<native_socket_type, error_code> wait_for_connection(std::chrono::milliseconds timeout) noexcept
+            {
+                // without a timeout accept() itself does the waiting
+                if (timeout.count() > 0 && not os::wait_readable(active_socket(), timeout))
+                    return tl::unexpected(error_code::no_socket_to_accept);
+
+                return active_socket();
+            }
+
+            os_socket_type socket_fd = os::uninitialised_socket;
+    };
+}
+
+#endif
@@ -5,6 +5,7 @@
 #include <arpa/inet.h>
 #include <netdb.h>
 #include <netinet/tcp.h>
+#include <poll.h>
 #include <unistd.h>
 
 #include <chrono>
@@ -58,14 +59,20 @@ namespace unet::detail::os
                 #endif
             }
 
-            inline void* os_ptr_cast(void* ptr) {
-                return ptr;
-            }
-
         private:
             os_socket_type listen_fd = uninitialised_socket;
     };
 
+    inline void* ptr_cast(void* ptr) {
+        return ptr;
+    }
+
+    inline bool wait_readable(native_socket_type sock, std::chrono::milliseconds timeout) noexcept
+    {
+        pollfd pfd{ sock, POLLIN, 0 };
+        return ::poll(&pfd, 1, timeout.count()) > 0;
+    }
+
     tl::expected<void, error_code> socket::listen_on_os_socket(os_socket_type& sock, int backlog_size, int socktype) noexcept
     {
         (void)socktype;
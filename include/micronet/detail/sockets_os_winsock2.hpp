@@ -142,10 +142,6 @@ namespace unet::detail::os
                 return event;
             }
 
-            inline char* os_ptr_cast(void* ptr) {
-                return reinterpret_cast<char*>(ptr);
-            }
-
         private:
             inline static WSADATA wsaData;
             inline static size_t instance_count;
@@ -154,6 +150,16 @@ namespace unet::detail::os
             std::unordered_set<SOCKET> listening_sockets;
     };
 
+    inline char* ptr_cast(void* ptr) {
+        return reinterpret_cast<char*>(ptr);
+    }
+
+    inline bool wait_readable(SOCKET sock, std::chrono::milliseconds timeout) noexcept
+    {
+        WSAPOLLFD pfd{ sock, POLLRDNORM, 0 };
+        return WSAPoll(&pfd, 1, static_cast<INT>(timeout.count())) > 0;
+    }
+
     tl::expected<void, error_code> socket::listen_on_os_socket(os_socket_type& sock, int backlog_size, int socktype) noexcept
     {
         if (listening_sockets.size() == 0) {
@@ -0,0 +1,149 @@
+#ifndef UNET_INTERNAL_TIMESTAMPING_HPP
+#define UNET_INTERNAL_TIMESTAMPING_HPP
+
+// Linux SO_TIMESTAMPING support, see Documentation/networking/timestamping.rst
+
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <linux/errqueue.h>
+#include <linux/net_tstamp.h>
+#include <linux/sockios.h>
+#include <netinet/in.h>
+
+#include <chrono>
+#include <cstdint>
+
+namespace unet
+{
+    // both software and hardware stamps are CLOCK_REALTIME based, a
+    // default constructed (epoch) value means the stamp was not reported
+    using kernel_time = std::chrono::sys_time<std::chrono::nanoseconds>;
+
+    enum class timestamp_source
+    {
+        software,
+        hardware,   // needs the NIC to be configured with SIOCSHWTSTAMP first
+    };
+
+    struct rx_timestamp
+    {
+        kernel_time software;
+        kernel_time hardware;
+    };
+
+    template <typename T>
+    struct timestamped
+    {
+        T data;
+        rx_timestamp timestamp;
+    };
+
+    // `id` is matched against tx_timestamp::id once the kernel reports on the send
+    struct send_result
+    {
+        size_t bytes;
+        uint32_t id;
+    };
+
+    enum class tx_timestamp_type
+    {
+        scheduled,  // entered the packet scheduler
+        sent,       // handed to the driver / NIC
+        acked,      // acknowledged by the peer, TCP only
+    };
+
+    struct tx_timestamp
+    {
+        uint32_t id;
+        tx_timestamp_type type;
+        kernel_time software;
+        kernel_time hardware;
+    };
+}
+
+namespace unet::detail
+{
+    constexpr static size_t timestamp_control_size = CMSG_SPACE(sizeof(scm_timestamping))
+                                                   + CMSG_SPACE(sizeof(sock_extended_err) + sizeof(sockaddr_in6));
+
+    inline int timestamping_flags(timestamp_source source, bool stream) noexcept
+    {
+        int flags = SOF_TIMESTAMPING_OPT_ID | SOF_TIMESTAMPING_OPT_TSONLY | SOF_TIMESTAMPING_TX_SCHED;
+
+        if (stream)
+            flags |= SOF_TIMESTAMPING_TX_ACK;
+
+        if (source == timestamp_source::hardware)
+            flags |= SOF_TIMESTAMPING_RX_HARDWARE | SOF_TIMESTAMPING_TX_HARDWARE | SOF_TIMESTAMPING_RAW_HARDWARE;
+        else
+            flags |= SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_TX_SOFTWARE;
+
+        // software reporting is always on, SCHED and ACK stamps are software only
+        return flags | SOF_TIMESTAMPING_SOFTWARE;
+    }
+
+    // bytes written but not yet acknowledged, the kernel starts TCP ids from there
+    inline uint32_t unacked_bytes(int socket_fd) noexcept
+    {
+        int outq = 0;
+        if (::ioctl(socket_fd, SIOCOUTQ, &outq) == -1)
+            return 0;
+        return static_cast<uint32_t>(outq);
+    }
+
+    inline kernel_time to_kernel_time(const timespec& ts) noexcept
+    {
+        return kernel_time(std::chrono::seconds(ts.tv_sec) + std::chrono::nanoseconds(ts.tv_nsec));
+    }
+
+    inline rx_timestamp parse_rx_timestamp(msghdr& msg) noexcept
+    {
+        rx_timestamp rval{};
+        for (cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg))
+        {
+            if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SO_TIMESTAMPING)
+                continue;
+
+            const auto* ts = reinterpret_cast<const scm_timestamping*>(CMSG_DATA(cmsg));
+            rval.software = to_kernel_time(ts->ts[0]);
+            rval.hardware = to_kernel_time(ts->ts[2]);
+        }
+        return rval;
+    }
+
+    // one error queue message carries a single stamp, returns false if it was something else
+    inline bool parse_tx_timestamp(msghdr& msg, tx_timestamp& out) noexcept
+    {
+        bool have_time = false;
+        bool have_id = false;
+
+        for (cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg))
+        {
+            if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SO_TIMESTAMPING)
+            {
+                const auto* ts = reinterpret_cast<const scm_timestamping*>(CMSG_DATA(cmsg));
+                out.software = to_kernel_time(ts->ts[0]);
+                out.hardware = to_kernel_time(ts->ts[2]);
+                have_time = true;
+            }
+            else if ((cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR)
+                  || (cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR))
+            {
+                const auto* err = reinterpret_cast<const sock_extended_err*>(CMSG_DATA(cmsg));
+                if (err->ee_errno != ENOMSG || err->ee_origin != SO_EE_ORIGIN_TIMESTAMPING)
+                    continue;
+
+                out.id = err->ee_data;
+                switch (err->ee_info) {
+                    case SCM_TSTAMP_SCHED: out.type = tx_timestamp_type::scheduled; break;
+                    case SCM_TSTAMP_ACK: out.type = tx_timestamp_type::acked; break;
+                    default: out.type = tx_timestamp_type::sent; break;
+                }
+                have_id = true;
+            }
+        }
+        return have_time && have_id;
+    }
+}
+
+#endif
@@ -26,6 +26,18 @@ namespace unet
         connection_reset_by_peer,
         cannot_connect,
         no_data_to_read,
+        cannot_set_option,
+        line_too_long,
+        malformed_message,
+        message_too_large,
+        tls_setup_failed,
+        tls_handshake_failed,
+        pool_exhausted,
+        shm_setup_failed,
+        rate_limited,
+        capture_failed,
+        checksum_mismatch,
+        timed_out,
 
         unimplemented,
     };
@@ -58,6 +70,30 @@ namespace unet
                 return "unimplemented";
             case error_code::no_data_to_read:
                 return "no data to read";
+            case error_code::cannot_set_option:
+                return "cannot set socket option";
+            case error_code::line_too_long:
+                return "line too long";
+            case error_code::malformed_message:
+                return "malformed message";
+            case error_code::message_too_large:
+                return "message too large";
+            case error_code::tls_setup_failed:
+                return "TLS setup failed";
+            case error_code::tls_handshake_failed:
+                return "TLS handshake failed";
+            case error_code::pool_exhausted:
+                return "connection pool exhausted";
+            case error_code::shm_setup_failed:
+                return "shared memory setup failed";
+            case error_code::rate_limited:
+                return "send rate limit reached";
+            case error_code::capture_failed:
+                return "cannot start capture";
+            case error_code::checksum_mismatch:
+                return "checksum mismatch";
+            case error_code::timed_out:
+                return "deadline passed";
        }
        __builtin_unreachable();
     }
@@ -0,0 +1,88 @@
+#ifndef UNET_INTERNAL_WORK_STEALING_DEQUE_HPP
+#define UNET_INTERNAL_WORK_STEALING_DEQUE_HPP
+
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <memory>
+
+namespace unet::detail
+{
+    // Fixed-capacity Chase-Lev deque of pointers, using the memory orderings
+    // of Lê et al., "Correct and Efficient Work-Stealing for Weak Memory
+    // Models".  The owner pushes and pops at the bottom, any thread may
+    // steal from the top.
+    template <typename T>
+    class work_stealing_deque
+    {
+        public:
+            explicit work_stealing_deque(size_t capacity)
+                : mask(std::bit_ceil(capacity) - 1),
+                  buffer(std::make_unique<std::atomic<T*>[]>(mask + 1)) {}
+
+            // owner only, false when full
+            bool push(T* item) noexcept
+            {
+                const int64_t b = bottom.load(std::memory_order_relaxed);
+                const int64_t t = top.load(std::memory_order_acquire);
+                if (b - t > static_cast<int64_t>(mask))
+                    return false;
+
+                buffer[b & mask].store(item, std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_release);
+                bottom.store(b + 1, std::memory_order_relaxed);
+                return true;
+            }
+
+            // owner only, newest first
+            T* pop() noexcept
+            {
+                const int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+                bottom.store(b, std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                int64_t t = top.load(std::memory_order_relaxed);
+
+                if (t > b) {
+                    bottom.store(b + 1, std::memory_order_relaxed);
+                    return nullptr;
+                }
+
+                T* item = buffer[b & mask].load(std::memory_order_relaxed);
+                if (t == b) {
+                    // last item, race the thieves for it
+                    if (not top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+                        item = nullptr;
+                    bottom.store(b + 1, std::memory_order_relaxed);
+                }
+                return item;
+            }
+
+            // any thread, oldest first
+            T* steal() noexcept
+            {
+                int64_t t = top.load(std::memory_order_acquire);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                const int64_t b = bottom.load(std::memory_order_acquire);
+
+                if (t >= b)
+                    return nullptr;
+
+                T* item = buffer[t & mask].load(std::memory_order_relaxed);
+                if (not top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+                    return nullptr;
+                return item;
+            }
+
+            bool empty() const noexcept {
+                return bottom.load(std::memory_order_relaxed) <= top.load(std::memory_order_relaxed);
+            }
+
+        private:
+            alignas(64) std::atomic<int64_t> top{0};
+            alignas(64) std::atomic<int64_t> bottom{0};
+            const size_t mask;
+            std::unique_ptr<std::atomic<T*>[]> buffer;
+    };
+}
+
+#endif
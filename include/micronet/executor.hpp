@@ -0,0 +1,401 @@
+#ifndef UNET_EXECUTOR_HPP
+#define UNET_EXECUTOR_HPP
+
+// Multi-threaded executor for connection handlers: one epoll reactor per
+// worker thread, and a work-stealing deque per worker so ready
+// connections queued behind a slow handler can run on an idle core.
+//
+// Connections are registered with one home reactor for their lifetime and
+// their handlers run there unless another worker steals the task, which
+// keeps connection state in the home core's cache in the common case.
+
+#if !defined(UNET_EPOLL)
+# error executor.hpp needs the epoll backend, define UNET_EPOLL
+#endif
+
+#include "basic_socket.hpp"
+#include "connection_table.hpp"
+#include "detail/work_stealing_deque.hpp"
+#include "detail/busy_poll.hpp"
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <pthread.h>
+
+#include <array>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace unet
+{
+    struct executor_opts
+    {
+        size_t threads = 0;             // 0 for std::thread::hardware_concurrency()
+        size_t queue_capacity = 1024;   // per worker, handlers run inline when full
+        bool pin_threads = false;       // pin worker i to CPU i
+
+        // idle workers keep polling epoll_wait(0) and stealing for this long
+        // before they block, 0 to park straight away
+        std::chrono::microseconds spin_budget{0};
+    };
+
+    struct executor_stats
+    {
+        uint64_t tasks_run      = 0;
+        uint64_t tasks_stolen   = 0;
+        uint64_t parks          = 0;    // times a worker ran out of work and blocked
+        uint64_t spin_polls     = 0;    // epoll_wait(0) calls made while spinning
+        uint64_t spin_hits      = 0;    // spins that found work before the budget ran out
+    };
+
+    template <typename Connection>
+    class basic_executor
+    {
+        public:
+            // runs when the connection is readable, return false to close it
+            using handler_type = std::function<bool(Connection&)>;
+
+            basic_executor() = default;
+            basic_executor(const basic_executor&) = delete;
+            ~basic_executor();
+
+            tl::expected<void, error_code> start(executor_opts opts = {}) noexcept;
+            void stop() noexcept;
+
+            // hands the connection over, round robin over the reactors
+            tl::expected<void, error_code> add(Connection conn, handler_type handler);
+
+            size_t thread_count() const noexcept { return workers.size(); }
+            executor_stats stats() const noexcept;
+
+        private:
+            struct entry
+            {
+                Connection conn;
+                handler_type handler;
+                connection_handle handle;
+                uint32_t home;
+            };
+
+            struct worker
+            {
+                explicit worker(size_t capacity) : tasks(capacity) {}
+                worker(const worker&) = delete;
+
+                ~worker()
+                {
+                    if (epoll_fd != -1)
+                        ::close(epoll_fd);
+                    if (wake_fd != -1)
+                        ::close(wake_fd);
+                }
+
+                int epoll_fd = -1;
+                int wake_fd = -1;
+                detail::work_stealing_deque<entry> tasks;
+
+                std::mutex table_lock;
+                connection_table<std::unique_ptr<entry>> table;
+
+                alignas(64) std::atomic<bool> parked = false;
+                std::atomic<uint64_t> tasks_run = 0;
+                std::atomic<uint64_t> tasks_stolen = 0;
+                std::atomic<uint64_t> parks = 0;
+                std::atomic<uint64_t> spin_polls = 0;
+                std::atomic<uint64_t> spin_hits = 0;
+
+                std::thread thread;
+            };
+
+            void run(uint32_t id) noexcept;
+            bool spin(uint32_t id) noexcept;
+            size_t poll_reactor(uint32_t id, int timeout) noexcept;
+            entry* steal(uint32_t thief) noexcept;
+            void execute(worker& self, entry* task, bool stolen) noexcept;
+            void wake_parked_peer(uint32_t self) noexcept;
+
+            std::vector<std::unique_ptr<worker>> workers;
+            std::atomic<bool> running = false;
+            std::atomic<uint32_t> next_home = 0;
+            std::chrono::microseconds spin_budget{0};
+    };
+}
+
+namespace unet
+{
+    template <typename Connection>
+    basic_executor<Connection>::~basic_executor()
+    {
+        stop();
+    }
+
+    template <typename Connection>
+    tl::expected<void, error_code> basic_executor<Connection>::start(executor_opts opts) noexcept
+    {
+        if (not workers.empty())
+            return tl::unexpected(error_code::socket_already_open);
+
+        spin_budget = opts.spin_budget;
+        const size_t thread_count = opts.threads ? opts.threads : std::max(1u, std::thread::hardware_concurrency());
+
+        for (size_t i = 0; i < thread_count; ++i)
+        {
+            auto w = std::make_unique<worker>(opts.queue_capacity);
+            w->epoll_fd = epoll_create1(0);
+            w->wake_fd = eventfd(0, EFD_NONBLOCK);
+
+            // the empty handle marks the wakeup eventfd
+            epoll_event wake_event = make_epoll_event({}, EPOLLIN);
+            if (w->epoll_fd == -1 || w->wake_fd == -1
+                || epoll_ctl(w->epoll_fd, EPOLL_CTL_ADD, w->wake_fd, &wake_event) == -1)
+            {
+                // the workers close their fds, this one's as well as those already made
+                workers.clear();
+                return tl::unexpected(error_code::multiplexing_error);
+            }
+            workers.push_back(std::move(w));
+        }
+
+        running.store(true);
+        for (uint32_t i = 0; i < workers.size(); ++i)
+        {
+            workers[i]->thread = std::thread([this, i] { run(i); });
+
+            if (opts.pin_threads) {
+                cpu_set_t cpus;
+                CPU_ZERO(&cpus);
+                CPU_SET(i % std::max(1u, std::thread::hardware_concurrency()), &cpus);
+                pthread_setaffinity_np(workers[i]->thread.native_handle(), sizeof(cpus), &cpus);
+            }
+        }
+        return {};
+    }
+
+    template <typename Connection>
+    void basic_executor<Connection>::stop() noexcept
+    {
+        running.store(false);
+
+        for (auto& w : workers) {
+            const uint64_t one = 1;
+            (void)::write(w->wake_fd, &one, sizeof(one));
+        }
+
+        for (auto& w : workers) {
+            if (w->thread.joinable())
+                w->thread.join();
+        }
+
+        // closes the connections and the workers' epoll and wakeup fds
+        workers.clear();
+    }
+
+    template <typename Connection>
+    tl::expected<void, error_code> basic_executor<Connection>::add(Connection conn, handler_type handler)
+    {
+        if (workers.empty())
+            return tl::unexpected(error_code::multiplexing_error);
+        if (not conn.is_active())
+            return tl::unexpected(error_code::no_active_socket);
+
+        const uint32_t home = next_home.fetch_add(1, std::memory_order_relaxed) % workers.size();
+        worker& w = *workers[home];
+
+        const native_socket_type fd = conn.native_socket();
+        auto task = std::make_unique<entry>(entry{ std::move(conn), std::move(handler), {}, home });
+        entry* raw = task.get();
+
+        {
+            std::lock_guard guard(w.table_lock);
+            raw->handle = w.table.insert(std::move(task));
+        }
+
+        // one-shot, so at most one task per connection exists at any time
+        epoll_event event = make_epoll_event(raw->handle, EPOLLIN | EPOLLONESHOT);
+        if (epoll_ctl(w.epoll_fd, EPOLL_CTL_ADD, fd, &event) == -1) {
+            std::lock_guard guard(w.table_lock);
+            w.table.erase(raw->handle);
+            return tl::unexpected(error_code::multiplexing_error);
+        }
+        return {};
+    }
+
+    template <typename Connection>
+    executor_stats basic_executor<Connection>::stats() const noexcept
+    {
+        executor_stats rval;
+        for (const auto& w : workers) {
+            rval.tasks_run += w->tasks_run.load(std::memory_order_relaxed);
+            rval.tasks_stolen += w->tasks_stolen.load(std::memory_order_relaxed);
+            rval.parks += w->parks.load(std::memory_order_relaxed);
+            rval.spin_polls += w->spin_polls.load(std::memory_order_relaxed);
+            rval.spin_hits += w->spin_hits.load(std::memory_order_relaxed);
+        }
+        return rval;
+    }
+
+    template <typename Connection>
+    void basic_executor<Connection>::run(uint32_t id) noexcept
+    {
+        worker& self = *workers[id];
+
+        while (running.load(std::memory_order_relaxed))
+        {
+            if (entry* task = self.tasks.pop()) {
+                execute(self, task, false);
+                continue;
+            }
+
+            if (poll_reactor(id, 0) > 0)
+                continue;
+
+            if (entry* task = steal(id)) {
+                execute(self, task, true);
+                continue;
+            }
+
+            if (spin_budget.count() != 0 && spin(id))
+                continue;
+
+            // announce parking first and look once more, pairs with the
+            // fence in wake_parked_peer() so a concurrent push is not missed
+            self.parked.store(true, std::memory_order_seq_cst);
+            if (entry* task = steal(id)) {
+                self.parked.store(false, std::memory_order_relaxed);
+                execute(self, task, true);
+                continue;
+            }
+
+            self.parks.fetch_add(1, std::memory_order_relaxed);
+            poll_reactor(id, -1);
+            self.parked.store(false, std::memory_order_relaxed);
+        }
+    }
+
+    // polls the reactor and the peers until something turns up or the spin
+    // budget runs out, true when work was found (and the stolen task run)
+    template <typename Connection>
+    bool basic_executor<Connection>::spin(uint32_t id) noexcept
+    {
+        worker& self = *workers[id];
+
+        const auto deadline = detail::spin_clock::now() + spin_budget;
+        uint64_t polls = 0;
+        bool found = false;
+
+        while (running.load(std::memory_order_relaxed))
+        {
+            polls++;
+            if (poll_reactor(id, 0) > 0) {
+                found = true;
+                break;
+            }
+            if (entry* task = steal(id)) {
+                execute(self, task, true);
+                found = true;
+                break;
+            }
+            if (detail::spin_clock::now() >= deadline)
+                break;
+            detail::cpu_relax();
+        }
+
+        self.spin_polls.fetch_add(polls, std::memory_order_relaxed);
+        if (found)
+            self.spin_hits.fetch_add(1, std::memory_order_relaxed);
+        return found;
+    }
+
+    template <typename Connection>
+    size_t basic_executor<Connection>::poll_reactor(uint32_t id, int timeout) noexcept
+    {
+        worker& self = *workers[id];
+
+        std::array<epoll_event, 64> events;
+        const int count = epoll_wait(self.epoll_fd, events.data(), events.size(), timeout);
+        if (count <= 0)
+            return 0;
+
+        std::array<entry*, 64> ready;
+        size_t ready_count = 0;
+        {
+            std::lock_guard guard(self.table_lock);
+            for (int i = 0; i < count; ++i) {
+                const connection_handle handle = handle_from_event(events[i]);
+                if (not handle.is_valid()) {
+                    uint64_t value;
+                    (void)::read(self.wake_fd, &value, sizeof(value));
+                    continue;
+                }
+                if (auto* task = self.table.find(handle))
+                    ready[ready_count++] = task->get();
+            }
+        }
+
+        size_t queued = 0;
+        for (size_t i = 0; i < ready_count; ++i) {
+            if (self.tasks.push(ready[i]))
+                queued++;
+            else
+                execute(self, ready[i], false);
+        }
+
+        // this worker can only run one of them at a time
+        if (queued > 1)
+            wake_parked_peer(id);
+
+        return ready_count;
+    }
+
+    template <typename Connection>
+    void basic_executor<Connection>::wake_parked_peer(uint32_t self) noexcept
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        for (size_t i = 1; i < workers.size(); ++i) {
+            worker& peer = *workers[(self + i) % workers.size()];
+            if (peer.parked.load(std::memory_order_seq_cst)) {
+                const uint64_t one = 1;
+                (void)::write(peer.wake_fd, &one, sizeof(one));
+                return;
+            }
+        }
+    }
+
+    template <typename Connection>
+    typename basic_executor<Connection>::entry* basic_executor<Connection>::steal(uint32_t thief) noexcept
+    {
+        for (size_t i = 1; i < workers.size(); ++i) {
+            if (entry* task = workers[(thief + i) % workers.size()]->tasks.steal())
+                return task;
+        }
+        return nullptr;
+    }
+
+    template <typename Connection>
+    void basic_executor<Connection>::execute(worker& self, entry* task, bool stolen) noexcept
+    {
+        worker& home = *workers[task->home];
+
+        const bool keep = task->handler(task->conn) && task->conn.is_active();
+
+        self.tasks_run.fetch_add(1, std::memory_order_relaxed);
+        if (stolen)
+            self.tasks_stolen.fetch_add(1, std::memory_order_relaxed);
+
+        if (keep) {
+            epoll_event event = make_epoll_event(task->handle, EPOLLIN | EPOLLONESHOT);
+            if (epoll_ctl(home.epoll_fd, EPOLL_CTL_MOD, task->conn.native_socket(), &event) == 0)
+                return;
+        }
+
+        std::lock_guard guard(home.table_lock);
+        home.table.erase(task->handle);
+    }
+}
+
+#endif
@@ -0,0 +1,639 @@
+#ifndef UNET_HTTP_HPP
+#define UNET_HTTP_HPP
+
+// Incremental HTTP/1.1 message parsing straight from the socket.
+//
+// http::head_parser finds the end of a request or response head, scanning
+// only the bytes that arrived since the previous attempt, then splits the
+// head into views of the buffer it was given: nothing is copied and
+// nothing is allocated.  http::chunked_decoder undoes chunked transfer
+// coding across partial reads.  http::message_reader ties both to a socket
+// with a receive buffer of its own and handles body framing, so requests
+// pipelined on a keep-alive connection come out one after another.
+//
+// Heads must use CRLF line endings, obsolete line folding is rejected.
+
+#include "detail/utility.hpp"
+#include "detail/delimiter_scanner.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <span>
+#include <string_view>
+
+namespace unet::http
+{
+    struct header
+    {
+        std::string_view name;
+        std::string_view value;
+    };
+
+    constexpr static size_t max_headers = 64;
+
+    // case-insensitive, for header names and tokens
+    constexpr bool iequals(std::string_view lhs, std::string_view rhs) noexcept
+    {
+        if (lhs.size() != rhs.size())
+            return false;
+
+        for (size_t i = 0; i < lhs.size(); ++i) {
+            const char l = lhs[i] >= 'A' && lhs[i] <= 'Z' ? lhs[i] + 32 : lhs[i];
+            const char r = rhs[i] >= 'A' && rhs[i] <= 'Z' ? rhs[i] + 32 : rhs[i];
+            if (l != r)
+                return false;
+        }
+        return true;
+    }
+
+    // what both heads have in common; all views point into the parsed buffer
+    struct message_head
+    {
+        int minor_version = 1;
+
+        std::array<header, max_headers> header_storage;
+        size_t header_count = 0;
+
+        // from the framing headers, filled in by the parser
+        int64_t content_length = -1;    // -1 without a Content-Length header
+        bool chunked = false;
+        bool keep_alive = true;
+
+        std::span<const header> headers() const noexcept { return { header_storage.data(), header_count }; }
+
+        // first header with that name, empty if there is none
+        std::string_view find(std::string_view name) const noexcept
+        {
+            for (const header& h : headers())
+                if (iequals(h.name, name))
+                    return h.value;
+            return {};
+        }
+    };
+
+    struct request_head : message_head
+    {
+        std::string_view method;
+        std::string_view target;
+    };
+
+    struct response_head : message_head
+    {
+        int status = 0;
+        std::string_view reason;
+    };
+}
+
+namespace unet::http::detail
+{
+    using unet::detail::static_scanner;
+    using unet::detail::no_match;
+
+    // RFC 9110 tchar
+    constexpr static std::array<bool, 256> token_chars = [] {
+        std::array<bool, 256> rval{};
+        for (int c = '0'; c <= '9'; ++c) rval[c] = true;
+        for (int c = 'a'; c <= 'z'; ++c) rval[c] = true;
+        for (int c = 'A'; c <= 'Z'; ++c) rval[c] = true;
+        for (char c : std::string_view("!#$%&'*+-.^_`|~"))
+            rval[static_cast<uint8_t>(c)] = true;
+        return rval;
+    }();
+
+    inline bool is_token(std::string_view s) noexcept
+    {
+        if (s.empty())
+            return false;
+        for (char c : s)
+            if (not token_chars[static_cast<uint8_t>(c)])
+                return false;
+        return true;
+    }
+
+    inline std::string_view trim(std::string_view s) noexcept
+    {
+        while (not s.empty() && (s.front() == ' ' || s.front() == '\t'))
+            s.remove_prefix(1);
+        while (not s.empty() && (s.back() == ' ' || s.back() == '\t'))
+            s.remove_suffix(1);
+        return s;
+    }
+
+    // next CRLF-terminated line of the head, advancing `rest` past it
+    inline std::string_view next_line(std::string_view& rest) noexcept
+    {
+        const size_t at = static_scanner<"\r\n">::find(reinterpret_cast<const uint8_t*>(rest.data()), rest.size());
+        const size_t end = at == no_match ? rest.size() : at;
+
+        std::string_view line = rest.substr(0, end);
+        rest.remove_prefix(std::min(rest.size(), end + 2));
+        return line;
+    }
+
+    // "HTTP/1.x"
+    inline bool parse_version(std::string_view s, int& minor) noexcept
+    {
+        if (s.size() != 8 || s.substr(0, 7) != "HTTP/1." || s[7] < '0' || s[7] > '9')
+            return false;
+        minor = s[7] - '0';
+        return true;
+    }
+
+    inline bool parse_content_length(std::string_view s, int64_t& out) noexcept
+    {
+        if (s.empty() || s.size() > 18)
+            return false;
+
+        int64_t value = 0;
+        for (char c : s) {
+            if (c < '0' || c > '9')
+                return false;
+            value = value * 10 + (c - '0');
+        }
+        out = value;
+        return true;
+    }
+
+    // does the comma separated list end with `token`
+    inline bool last_token_is(std::string_view list, std::string_view token) noexcept
+    {
+        const size_t comma = list.rfind(',');
+        return iequals(trim(comma == std::string_view::npos ? list : list.substr(comma + 1)), token);
+    }
+
+    inline bool has_token(std::string_view list, std::string_view token) noexcept
+    {
+        while (not list.empty()) {
+            const size_t comma = list.find(',');
+            if (iequals(trim(list.substr(0, comma)), token))
+                return true;
+            if (comma == std::string_view::npos)
+                break;
+            list.remove_prefix(comma + 1);
+        }
+        return false;
+    }
+
+    // the header lines of a complete head, start line already removed
+    inline bool parse_headers(std::string_view rest, message_head& out, bool is_request) noexcept
+    {
+        out.header_count = 0;
+        out.content_length = -1;
+        out.chunked = false;
+
+        bool has_transfer_encoding = false;
+        std::string_view connection;
+
+        while (not rest.empty())
+        {
+            const std::string_view line = next_line(rest);
+            if (line.empty())
+                break;
+
+            const size_t colon = line.find(':');
+            if (colon == std::string_view::npos || out.header_count == max_headers)
+                return false;
+
+            // also rejects obsolete folding, which starts with whitespace
+            const std::string_view name = line.substr(0, colon);
+            if (not is_token(name))
+                return false;
+
+            const std::string_view value = trim(line.substr(colon + 1));
+            out.header_storage[out.header_count++] = { name, value };
+
+            if (iequals(name, "content-length")) {
+                int64_t length;
+                if (not parse_content_length(value, length))
+                    return false;
+                if (out.content_length != -1 && out.content_length != length)
+                    return false;
+                out.content_length = length;
+            } else if (iequals(name, "transfer-encoding")) {
+                has_transfer_encoding = true;
+                out.chunked = last_token_is(value, "chunked");
+            } else if (iequals(name, "connection")) {
+                connection = value;
+            }
+        }
+
+        // RFC 9112 6.3: a request body that isn't chunked can't be delimited
+        if (has_transfer_encoding && is_request && not out.chunked)
+            return false;
+        if (has_transfer_encoding)
+            out.content_length = -1;
+
+        out.keep_alive = out.minor_version >= 1 ? not has_token(connection, "close")
+                                                : has_token(connection, "keep-alive");
+        return true;
+    }
+}
+
+namespace unet::http
+{
+    // Finds and parses one message head at the start of a buffer.  Call it
+    // again with the same, grown, buffer after more data arrived; only the
+    // new bytes are scanned for the end of the head.  The views in `out`
+    // point into the buffer.
+    class head_parser
+    {
+        public:
+            // head size once complete, 0 while more data is needed
+            tl::expected<size_t, error_code> parse(std::string_view buffer, request_head& out) noexcept
+            {
+                const size_t size = find_end(buffer);
+                if (size == 0)
+                    return 0;
+
+                std::string_view rest = buffer.substr(0, size);
+                const std::string_view line = detail::next_line(rest);
+
+                const size_t first_space = line.find(' ');
+                const size_t second_space = line.find(' ', first_space + 1);
+                if (first_space == std::string_view::npos || second_space == std::string_view::npos)
+                    return tl::unexpected(error_code::malformed_message);
+
+                out.method = line.substr(0, first_space);
+                out.target = line.substr(first_space + 1, second_space - first_space - 1);
+
+                if (not detail::is_token(out.method) || out.target.empty()
+                    || not detail::parse_version(line.substr(second_space + 1), out.minor_version)
+                    || not detail::parse_headers(rest, out, true))
+                    return tl::unexpected(error_code::malformed_message);
+
+                return size;
+            }
+
+            tl::expected<size_t, error_code> parse(std::string_view buffer, response_head& out) noexcept
+            {
+                const size_t size = find_end(buffer);
+                if (size == 0)
+                    return 0;
+
+                std::string_view rest = buffer.substr(0, size);
+                const std::string_view line = detail::next_line(rest);
+
+                // "HTTP/1.1 200 OK", the reason may be empty
+                if (line.size() < 12 || line[8] != ' ' || (line.size() > 12 && line[12] != ' ')
+                    || not detail::parse_version(line.substr(0, 8), out.minor_version))
+                    return tl::unexpected(error_code::malformed_message);
+
+                out.status = 0;
+                for (char c : line.substr(9, 3)) {
+                    if (c < '0' || c > '9')
+                        return tl::unexpected(error_code::malformed_message);
+                    out.status = out.status * 10 + (c - '0');
+                }
+                out.reason = line.size() > 13 ? line.substr(13) : std::string_view{};
+
+                if (not detail::parse_headers(rest, out, false))
+                    return tl::unexpected(error_code::malformed_message);
+
+                return size;
+            }
+
+            // for the next message
+            void reset() noexcept { scanned = 0; }
+
+        private:
+            // length including the blank line, 0 when not there yet
+            size_t find_end(std::string_view buffer) noexcept
+            {
+                // the terminator may straddle the previously scanned bytes
+                const size_t from = scanned >= 3 ? scanned - 3 : 0;
+                const size_t at = detail::static_scanner<"\r\n\r\n">::find(reinterpret_cast<const uint8_t*>(buffer.data()) + from,
+                                                                           buffer.size() - from);
+                if (at == detail::no_match) {
+                    scanned = buffer.size();
+                    return 0;
+                }
+
+                scanned = 0;
+                return from + at + 4;
+            }
+
+            size_t scanned = 0;
+    };
+
+    // Decodes a chunked body fed in arbitrary pieces.  Chunk extensions and
+    // trailers are skipped.
+    class chunked_decoder
+    {
+        public:
+            // passes the body bytes in `input` to sink(std::string_view) and
+            // returns how much of input belonged to the body; less than
+            // input.size() only once done(), the rest is the next message
+            template <typename Sink>
+            tl::expected<size_t, error_code> decode(std::string_view input, Sink&& sink)
+            {
+                size_t i = 0;
+                while (i < input.size() && current != state::done)
+                {
+                    if (current == state::data) {
+                        const size_t n = static_cast<size_t>(std::min<uint64_t>(remaining, input.size() - i));
+                        sink(input.substr(i, n));
+                        i += n;
+                        remaining -= n;
+                        if (remaining == 0)
+                            current = state::data_cr;
+                        continue;
+                    }
+
+                    if (not step(input[i++]))
+                        return tl::unexpected(error_code::malformed_message);
+                }
+                return i;
+            }
+
+            bool done() const noexcept { return current == state::done; }
+            void reset() noexcept { *this = chunked_decoder{}; }
+
+        private:
+            enum class state : uint8_t
+            {
+                size, extension, size_lf, data, data_cr, data_lf, trailer_start, trailer_line, trailer_end_lf, done
+            };
+
+            static int hex_value(char c) noexcept
+            {
+                if (c >= '0' && c <= '9') return c - '0';
+                if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+                if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+                return -1;
+            }
+
+            // everything but chunk data, a byte at a time
+            bool step(char c) noexcept
+            {
+                switch (current)
+                {
+                    case state::size:
+                        if (const int digit = hex_value(c); digit >= 0) {
+                            if (remaining >> 56)
+                                return false;
+                            remaining = remaining * 16 + digit;
+                            digits++;
+                            return true;
+                        }
+                        if (digits == 0)
+                            return false;
+                        if (c == ';' || c == ' ' || c == '\t')
+                            current = state::extension;
+                        else if (c == '\r')
+                            current = state::size_lf;
+                        else if (c == '\n')
+                            end_of_size_line();
+                        else
+                            return false;
+                        return true;
+
+                    case state::extension:
+                        if (c == '\r')
+                            current = state::size_lf;
+                        else if (c == '\n')
+                            end_of_size_line();
+                        return true;
+
+                    case state::size_lf:
+                        if (c != '\n')
+                            return false;
+                        end_of_size_line();
+                        return true;
+
+                    case state::data_cr:
+                        if (c == '\r')
+                            current = state::data_lf;
+                        else if (c == '\n')
+                            current = state::size;
+                        else
+                            return false;
+                        return true;
+
+                    case state::data_lf:
+                        if (c != '\n')
+                            return false;
+                        current = state::size;
+                        return true;
+
+                    case state::trailer_start:
+                        current = c == '\r' ? state::trailer_end_lf : c == '\n' ? state::done : state::trailer_line;
+                        return true;
+
+                    case state::trailer_line:
+                        if (c == '\n')
+                            current = state::trailer_start;
+                        return true;
+
+                    case state::trailer_end_lf:
+                        if (c != '\n')
+                            return false;
+                        current = state::done;
+                        return true;
+
+                    case state::data:
+                    case state::done:
+                        break;
+                }
+                return false;
+            }
+
+            void end_of_size_line() noexcept
+            {
+                current = remaining == 0 ? state::trailer_start : state::data;
+                digits = 0;
+            }
+
+            uint64_t remaining = 0;
+            uint32_t digits = 0;
+            state current = state::size;
+    };
+
+    // Reads messages off a socket into a buffer of its own.  Head views stay
+    // valid until the next read_request()/read_response(); body pieces only
+    // for the duration of the sink call.  Unread body bytes are skipped when
+    // the next head is read, so pipelined messages need no extra care.
+    template <typename Socket>
+    class message_reader
+    {
+        public:
+            constexpr static size_t initial_capacity = 16 * 1024;
+
+            explicit message_reader(Socket& s, size_t max_head_size = 64 * 1024) noexcept
+                : sock(s), max_head(max_head_size) {}
+
+            message_reader(const message_reader&) = delete;
+
+            tl::expected<void, error_code> read_request(request_head& head) noexcept
+            {
+                auto size = read_head(head);
+                if (not size.has_value())
+                    return tl::unexpected(size.error());
+
+                set_body(head.chunked ? framing::chunked : framing::length,
+                         head.content_length > 0 ? head.content_length : 0);
+                return {};
+            }
+
+            // `head_request` when the request was a HEAD, whose response has no body
+            tl::expected<void, error_code> read_response(response_head& head, bool head_request = false) noexcept
+            {
+                auto size = read_head(head);
+                if (not size.has_value())
+                    return tl::unexpected(size.error());
+
+                if (head_request || head.status < 200 || head.status == 204 || head.status == 304)
+                    set_body(framing::length, 0);
+                else if (head.chunked)
+                    set_body(framing::chunked, 0);
+                else if (head.content_length >= 0)
+                    set_body(framing::length, head.content_length);
+                else
+                    set_body(framing::until_close, 0);
+                return {};
+            }
+
+            // streams the body of the last head to sink(std::string_view)
+            template <typename Sink>
+            tl::expected<void, error_code> read_body(Sink&& sink) noexcept
+            {
+                while (body != framing::none)
+                {
+                    if (start == filled) {
+                        // everything up to head_end is the head, keep it in place
+                        start = filled = head_end;
+                        if (auto res = fill(); not res.has_value()) {
+                            if (body == framing::until_close && res.error() == error_code::connection_reset_by_peer) {
+                                body = framing::none;
+                                return {};
+                            }
+                            return res;
+                        }
+                    }
+
+                    const std::string_view available(buffer.get() + start, filled - start);
+
+                    if (body == framing::chunked) {
+                        auto used = decoder.decode(available, sink);
+                        if (not used.has_value())
+                            return tl::unexpected(used.error());
+                        start += used.value();
+                        if (decoder.done())
+                            body = framing::none;
+                    } else {
+                        const size_t n = body == framing::length ? static_cast<size_t>(std::min<uint64_t>(body_left, available.size()))
+                                                                 : available.size();
+                        sink(available.substr(0, n));
+                        start += n;
+                        if (body == framing::length && (body_left -= n) == 0)
+                            body = framing::none;
+                    }
+                }
+                return {};
+            }
+
+            tl::expected<void, error_code> skip_body() noexcept {
+                return read_body([](std::string_view) {});
+            }
+
+            // received but not yet parsed, e.g. when switching protocols
+            std::string_view buffered() const noexcept {
+                return std::string_view(buffer.get() + start, filled - start);
+            }
+
+        private:
+            enum class framing : uint8_t { none, length, chunked, until_close };
+
+            template <typename Head>
+            tl::expected<size_t, error_code> read_head(Head& head) noexcept
+            {
+                if (auto skipped = skip_body(); not skipped.has_value())
+                    return tl::unexpected(skipped.error());
+
+                // the previous head's views are given up from here on
+                parser.reset();
+                head_end = 0;
+                retired.reset();
+
+                while (true)
+                {
+                    auto size = parser.parse(std::string_view(buffer.get() + start, filled - start), head);
+                    if (not size.has_value())
+                        return size;
+
+                    if (size.value() != 0) {
+                        start += size.value();
+                        head_end = start;
+                        return size;
+                    }
+
+                    if (filled - start >= max_head)
+                        return tl::unexpected(error_code::message_too_large);
+
+                    if (auto res = fill(); not res.has_value())
+                        return tl::unexpected(res.error());
+                }
+            }
+
+            void set_body(framing f, int64_t length) noexcept
+            {
+                body = f == framing::length && length == 0 ? framing::none : f;
+                body_left = static_cast<uint64_t>(length);
+                decoder.reset();
+            }
+
+            // one receive after the buffered bytes, making room first
+            tl::expected<void, error_code> fill() noexcept
+            {
+                if (filled == capacity) {
+                    if (start > head_end) {
+                        // the parser's resume point is relative to start, so it moves along
+                        std::memmove(buffer.get() + head_end, buffer.get() + start, filled - start);
+                        filled -= start - head_end;
+                        start = head_end;
+                    } else {
+                        const size_t grown = capacity == 0 ? initial_capacity : capacity * 2;
+                        std::unique_ptr<char[]> replacement(new (std::nothrow) char[grown]);
+                        if (replacement == nullptr)
+                            return tl::unexpected(error_code::message_too_large);
+                        if (filled != 0)
+                            std::memcpy(replacement.get(), buffer.get(), filled);
+
+                        // a head that fills the buffer exactly is still being
+                        // looked at through its views, free it with the next head
+                        if (head_end != 0 && retired == nullptr)
+                            retired = std::move(buffer);
+                        buffer = std::move(replacement);
+                        capacity = grown;
+                    }
+                }
+
+                auto received = sock.recv_some(std::span<char>(buffer.get() + filled, capacity - filled));
+                if (not received.has_value())
+                    return tl::unexpected(received.error());
+
+                filled += received.value();
+                return {};
+            }
+
+            Socket& sock;
+            size_t max_head;
+
+            std::unique_ptr<char[]> buffer;
+            std::unique_ptr<char[]> retired;    // the block the current head's views point into, if it moved
+            size_t capacity = 0;
+            size_t start = 0;
+            size_t filled = 0;
+            size_t head_end = 0;    // while a body is read, the head before it
+
+            head_parser parser;
+            chunked_decoder decoder;
+            framing body = framing::none;
+            uint64_t body_left = 0;
+    };
+}
+
+#endif
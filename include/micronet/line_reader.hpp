@@ -0,0 +1,179 @@
+#ifndef UNET_LINE_READER_HPP
+#define UNET_LINE_READER_HPP
+
+// Buffered reader yielding delimited records as views into its own receive
+// buffer, so reading a line costs no allocation once the buffer has grown
+// to fit the longest one:
+//
+//     for (std::string_view line : sock.lines('\n'))
+//         ...
+//
+// A view is only valid until the iterator is incremented.  Bytes read past
+// the last yielded line stay in the reader, see buffered().
+
+#include "detail/utility.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <span>
+#include <string_view>
+
+namespace unet
+{
+    template <typename Socket>
+    class line_reader
+    {
+        public:
+            constexpr static size_t initial_capacity = 16 * 1024;
+
+            class iterator
+            {
+                public:
+                    using iterator_concept  = std::input_iterator_tag;
+                    using value_type        = std::string_view;
+                    using difference_type   = std::ptrdiff_t;
+
+                    iterator() noexcept = default;
+                    explicit iterator(line_reader* r) noexcept : reader(r) {}
+
+                    std::string_view operator*() const noexcept { return reader->current; }
+
+                    iterator& operator++() noexcept {
+                        if (not reader->next())
+                            reader = nullptr;
+                        return *this;
+                    }
+                    void operator++(int) noexcept { ++*this; }
+
+                    bool operator==(std::default_sentinel_t) const noexcept { return reader == nullptr; }
+
+                private:
+                    line_reader* reader = nullptr;
+            };
+
+            // lines longer than max_line_length, delimiter excluded, end the
+            // iteration with error_code::line_too_long
+            line_reader(Socket& s, char delim, size_t max_line_length) noexcept
+                : sock(s), delimiter(delim), max_line(max_line_length) {}
+
+            line_reader(const line_reader&) = delete;
+            line_reader(line_reader&&) noexcept = default;
+
+            iterator begin() noexcept { return next() ? iterator(this) : iterator(); }
+            std::default_sentinel_t end() const noexcept { return {}; }
+
+            // why iteration stopped; the peer closing the connection is not an error
+            tl::expected<void, error_code> status() const noexcept {
+                if (failed)
+                    return tl::unexpected(failure);
+                return {};
+            }
+
+            // received but not yet yielded
+            std::string_view buffered() const noexcept {
+                return std::string_view(buffer.get() + start, filled - start);
+            }
+
+        private:
+            bool next() noexcept
+            {
+                while (true)
+                {
+                    const void* hit = filled > scanned ? std::memchr(buffer.get() + scanned, delimiter, filled - scanned) : nullptr;
+                    if (hit != nullptr) {
+                        const size_t at = static_cast<const char*>(hit) - buffer.get();
+                        if (at - start > max_line)
+                            return fail(error_code::line_too_long);
+
+                        current = std::string_view(buffer.get() + start, at - start);
+                        start = scanned = at + 1;
+                        return true;
+                    }
+                    scanned = filled;
+
+                    if (filled - start > max_line)
+                        return fail(error_code::line_too_long);
+
+                    if (peer_closed)
+                        return false;
+
+                    if (filled == capacity) {
+                        if (auto room = make_room(); not room.has_value())
+                            return fail(room.error());
+                    }
+
+                    auto received = sock.recv_some(std::span<char>(buffer.get() + filled, capacity - filled));
+                    if (not received.has_value()) {
+                        if (received.error() != error_code::connection_reset_by_peer)
+                            return fail(received.error());
+
+                        // an unterminated last line still counts
+                        peer_closed = true;
+                        if (filled == start)
+                            return false;
+                        current = std::string_view(buffer.get() + start, filled - start);
+                        start = scanned = filled;
+                        return true;
+                    }
+                    filled += received.value();
+                }
+            }
+
+            // moves the partial line to the front, or grows the buffer when
+            // it already starts there, up to what the longest line needs
+            tl::expected<void, error_code> make_room() noexcept
+            {
+                if (start > 0) {
+                    std::memmove(buffer.get(), buffer.get() + start, filled - start);
+                    filled -= start;
+                    scanned -= start;
+                    start = 0;
+                    return {};
+                }
+
+                // the line and its delimiter, saturated for an unlimited max_line
+                const size_t limit = max_line < SIZE_MAX ? max_line + 1 : SIZE_MAX;
+                if (capacity >= limit)
+                    return tl::unexpected(error_code::line_too_long);
+
+                const size_t grown = capacity == 0 ? std::min(initial_capacity, limit)
+                                   : capacity > limit / 2 ? limit : capacity * 2;
+                std::unique_ptr<char[]> replacement(new (std::nothrow) char[grown]);
+                if (replacement == nullptr)
+                    return tl::unexpected(error_code::message_too_large);
+                if (filled != 0)
+                    std::memcpy(replacement.get(), buffer.get(), filled);
+
+                buffer = std::move(replacement);
+                capacity = grown;
+                return {};
+            }
+
+            bool fail(error_code err) noexcept {
+                failed = true;
+                failure = err;
+                return false;
+            }
+
+            Socket& sock;
+            char delimiter;
+            size_t max_line;
+
+            std::unique_ptr<char[]> buffer;
+            size_t capacity = 0;
+            size_t start = 0;       // first byte of the line being read
+            size_t scanned = 0;     // no delimiter before this
+            size_t filled = 0;
+
+            std::string_view current;
+            bool peer_closed = false;
+            bool failed = false;
+            error_code failure = error_code::unimplemented;
+    };
+}
+
+#endif
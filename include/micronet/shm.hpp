@@ -0,0 +1,444 @@
+#ifndef UNET_SOCKETS_SHM_HPP
+#define UNET_SOCKETS_SHM_HPP
+
+// Shared memory transport for peers on the same host.  The connection is
+// an abstract-namespace UNIX socket named after the port, used for the
+// handshake and to notice a peer that went away; the data goes through a
+// memfd mapping with one single-producer/single-consumer byte ring per
+// direction:
+//
+//     unet::shm_socket listener;          unet::shm_socket client;
+//     listener.listen(7000);              client.connect("localhost", 7000);
+//     auto conn = listener.accept();      client.send(request);
+//
+// send/recv are a copy into or out of the ring and a couple of atomics, a
+// futex wakeup is only made when the other side is parked.  The host
+// passed to connect() is not used.
+//
+// The fd never becomes readable, so these sockets can't be waited on with
+// epoll and don't work with the executor.
+//
+// Any process of the same user can connect to the abstract socket, so
+// only peers running as the same effective uid (SO_PEERCRED) are
+// accepted or connected to.  Such a peer is trusted not to be hostile
+// beyond the mapping: ring sizes and positions it writes are checked, and
+// one that makes no sense fails the connection with EPROTO.
+
+#if !defined(__linux__) && !defined(__linux)
+# error shm.hpp is Linux only
+#endif
+
+#include "basic_socket.hpp"
+
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <limits>
+#include <new>
+
+namespace unet
+{
+    struct socktype_shm
+    {
+        constexpr static int    domain          = AF_UNIX;
+        constexpr static int    type            = SOCK_STREAM;
+        constexpr static bool   secure          = false;
+        constexpr static bool   shared_memory   = true;
+        constexpr static size_t shm_ring_size   = 1 << 20;  // per direction, set by the accepting side
+    };
+}
+
+namespace unet::detail
+{
+    // "\0unet-shm-<port>", so nothing is left behind in the file system
+    inline socklen_t local_address(uint16_t port, sockaddr_un& address) noexcept
+    {
+        address = {};
+        address.sun_family = AF_UNIX;
+        const int length = snprintf(address.sun_path + 1, sizeof(address.sun_path) - 1, "unet-shm-%u", unsigned(port));
+        return static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + 1 + length);
+    }
+
+    // single_socket_storage over a local socket instead of an IP one
+    class local_socket_storage : public single_socket_storage
+    {
+        protected:
+            local_socket_storage() = default;
+            local_socket_storage(local_socket_storage&& other) noexcept : single_socket_storage(std::move(other)) {}
+
+            tl::expected<void, error_code> open_sockets(const std::string& host, uint16_t port, int socktype) noexcept
+            {
+                if (socket_fd > 0)
+                    return tl::unexpected(error_code::socket_already_open);
+
+                sockaddr_un address;
+                const socklen_t length = local_address(port, address);
+                const error_code failure = host.empty() ? error_code::cannot_open_socket : error_code::cannot_connect;
+
+                socket_fd = ::socket(AF_UNIX, socktype | SOCK_CLOEXEC, 0);
+                if (socket_fd == os::socket_error) {
+                    socket_fd = os::uninitialised_socket;
+                    return tl::unexpected(failure);
+                }
+
+                const sockaddr* addr = reinterpret_cast<const sockaddr*>(&address);
+                if ((host.empty() ? ::bind(socket_fd, addr, length) : ::connect(socket_fd, addr, length)) == -1) {
+                    close_sockets();
+                    return tl::unexpected(failure);
+                }
+                return {};
+            }
+    };
+
+    struct shm_ring_header
+    {
+        alignas(64) std::atomic<uint64_t> head = 0;             // consumer position
+        alignas(64) std::atomic<uint64_t> tail = 0;             // producer position
+
+        // futex words, 1 while that side sleeps
+        alignas(64) std::atomic<uint32_t> reader_parked = 0;
+        alignas(64) std::atomic<uint32_t> writer_parked = 0;
+
+        alignas(64) std::atomic<uint32_t> writer_closed = 0;
+        std::atomic<uint32_t> reader_closed = 0;
+    };
+
+    static_assert(std::atomic<uint64_t>::is_always_lock_free && std::atomic<uint32_t>::is_always_lock_free,
+                  "ring positions are shared between processes");
+
+    // sent with the memfd by the accepting side
+    struct shm_hello
+    {
+        constexpr static uint32_t expected_magic = 0x756e6d31;  // "unm1"
+        constexpr static uint64_t max_ring_size = uint64_t(1) << 30;
+
+        uint32_t magic;
+        uint32_t reserved;
+        uint64_t ring_size;
+    };
+
+    template <>
+    class shm_state<true>
+    {
+        public:
+            // how often a parked side checks that the peer still exists
+            constexpr static int peer_check_ms = 100;
+
+            shm_state() noexcept = default;
+            shm_state(shm_state&& other) noexcept { *this = std::move(other); }
+            shm_state& operator=(shm_state&& other) noexcept
+            {
+                std::swap(mapping, other.mapping);
+                std::swap(mapping_size, other.mapping_size);
+                std::swap(tx, other.tx);
+                std::swap(rx, other.rx);
+                return *this;
+            }
+            ~shm_state() { shutdown(); }
+
+            // accepting side: maps both rings and passes the memfd over
+            tl::expected<void, error_code> create(native_socket_type fd, size_t ring_size) noexcept
+            {
+                if (not valid_ring_size(ring_size) || not same_user(fd))
+                    return tl::unexpected(error_code::shm_setup_failed);
+
+                const int memfd = ::memfd_create("unet-shm", MFD_CLOEXEC);
+                if (memfd == -1)
+                    return tl::unexpected(error_code::shm_setup_failed);
+
+                const size_t length = 2 * (sizeof(shm_ring_header) + ring_size);
+                bool ok = ::ftruncate(memfd, length) == 0 && map(memfd, length, ring_size, 0);
+                if (ok) {
+                    new (tx.header) shm_ring_header;
+                    new (rx.header) shm_ring_header;
+                    ok = send_hello(fd, memfd, ring_size);
+                }
+                ::close(memfd);
+
+                if (not ok) {
+                    shutdown();
+                    return tl::unexpected(error_code::shm_setup_failed);
+                }
+                return {};
+            }
+
+            // connecting side
+            tl::expected<void, error_code> attach(native_socket_type fd) noexcept
+            {
+                if (not same_user(fd))
+                    return tl::unexpected(error_code::shm_setup_failed);
+
+                shm_hello hello{};
+                const int memfd = receive_hello(fd, hello);
+                if (memfd == -1)
+                    return tl::unexpected(error_code::shm_setup_failed);
+
+                // the size is capped before it goes into the length, which then can't overflow
+                const bool valid = hello.magic == shm_hello::expected_magic && valid_ring_size(hello.ring_size);
+                const uint64_t length = valid ? 2 * (sizeof(shm_ring_header) + hello.ring_size) : 0;
+                struct stat info;
+                const bool ok = valid && length <= std::numeric_limits<size_t>::max()
+                                && ::fstat(memfd, &info) == 0 && info.st_size >= 0 && uint64_t(info.st_size) >= length
+                                && map(memfd, size_t(length), size_t(hello.ring_size), 1);
+                ::close(memfd);
+
+                if (not ok)
+                    return tl::unexpected(error_code::shm_setup_failed);
+                return {};
+            }
+
+            ssize_t write(native_socket_type fd, const void* data, size_t size, int flags) noexcept
+            {
+                shm_ring_header& ring = *tx.header;
+                while (true) {
+                    if (ring.reader_closed.load(std::memory_order_acquire)) {
+                        errno = EPIPE;
+                        return -1;
+                    }
+
+                    const uint64_t tail = ring.tail.load(std::memory_order_relaxed);
+                    const uint64_t head = ring.head.load(std::memory_order_acquire);
+                    if (tail - head > tx.size) {
+                        errno = EPROTO;     // the peer moved head past what was written
+                        return -1;
+                    }
+                    const size_t space = tx.size - (tail - head);
+
+                    if (space > 0) {
+                        const size_t n = std::min(space, size);
+                        copy_in(tail, static_cast<const char*>(data), n);
+                        ring.tail.store(tail + n, std::memory_order_release);
+                        wake(ring.reader_parked);
+                        return n;
+                    }
+
+                    if (flags & MSG_DONTWAIT) {
+                        errno = EAGAIN;
+                        return -1;
+                    }
+
+                    const bool peer_alive = park(fd, ring.writer_parked, [&] {
+                        return ring.head.load(std::memory_order_acquire) != head
+                               || ring.reader_closed.load(std::memory_order_acquire);
+                    });
+                    if (not peer_alive) {
+                        errno = EPIPE;
+                        return -1;
+                    }
+                }
+            }
+
+            ssize_t read(native_socket_type fd, void* data, size_t size, int flags) noexcept
+            {
+                shm_ring_header& ring = *rx.header;
+                while (true) {
+                    const uint64_t head = ring.head.load(std::memory_order_relaxed);
+                    const uint64_t tail = ring.tail.load(std::memory_order_acquire);
+                    if (tail - head > rx.size) {
+                        errno = EPROTO;     // the peer wrote more than the ring holds
+                        return -1;
+                    }
+
+                    if (tail != head) {
+                        const size_t n = std::min<size_t>(tail - head, size);
+                        copy_out(head, static_cast<char*>(data), n);
+                        if (not (flags & MSG_PEEK)) {
+                            ring.head.store(head + n, std::memory_order_release);
+                            wake(ring.writer_parked);
+                        }
+                        return n;
+                    }
+
+                    // everything written before the close has been read
+                    if (ring.writer_closed.load(std::memory_order_acquire))
+                        return 0;
+
+                    if (flags & MSG_DONTWAIT) {
+                        errno = EAGAIN;
+                        return -1;
+                    }
+
+                    const bool peer_alive = park(fd, ring.reader_parked, [&] {
+                        return ring.tail.load(std::memory_order_acquire) != tail
+                               || ring.writer_closed.load(std::memory_order_acquire);
+                    });
+                    if (not peer_alive)
+                        return 0;
+                }
+            }
+
+            // tells the peer, then unmaps; the socket is closed by the caller
+            void shutdown() noexcept
+            {
+                if (mapping == nullptr)
+                    return;
+
+                tx.header->writer_closed.store(1, std::memory_order_release);
+                rx.header->reader_closed.store(1, std::memory_order_release);
+                wake(tx.header->reader_parked);
+                wake(rx.header->writer_parked);
+
+                ::munmap(mapping, mapping_size);
+                mapping = nullptr;
+                mapping_size = 0;
+                tx = {};
+                rx = {};
+            }
+
+        private:
+            struct ring_view
+            {
+                shm_ring_header* header = nullptr;
+                char* data = nullptr;
+                size_t size = 0;
+            };
+
+            static bool valid_ring_size(uint64_t ring_size) noexcept
+            {
+                return ring_size != 0 && ring_size <= shm_hello::max_ring_size && (ring_size & (ring_size - 1)) == 0;
+            }
+
+            // the peer on the rendezvous socket runs as this process's user
+            static bool same_user(native_socket_type fd) noexcept
+            {
+                ucred peer{};
+                socklen_t length = sizeof(peer);
+                return ::getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &peer, &length) == 0 && peer.uid == ::geteuid();
+            }
+
+            // ring 0 carries accepting side -> connecting side, ring 1 the other way
+            bool map(int memfd, size_t length, size_t ring_size, int tx_index) noexcept
+            {
+                void* base = ::mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+                if (base == MAP_FAILED)
+                    return false;
+
+                mapping = base;
+                mapping_size = length;
+
+                char* rings[2];
+                rings[0] = static_cast<char*>(base);
+                rings[1] = rings[0] + sizeof(shm_ring_header) + ring_size;
+
+                tx = { reinterpret_cast<shm_ring_header*>(rings[tx_index]), rings[tx_index] + sizeof(shm_ring_header), ring_size };
+                rx = { reinterpret_cast<shm_ring_header*>(rings[1 - tx_index]), rings[1 - tx_index] + sizeof(shm_ring_header), ring_size };
+                return true;
+            }
+
+            void copy_in(uint64_t position, const char* data, size_t n) noexcept
+            {
+                const size_t offset = position & (tx.size - 1);
+                const size_t first = std::min(n, tx.size - offset);
+                std::memcpy(tx.data + offset, data, first);
+                std::memcpy(tx.data, data + first, n - first);
+            }
+
+            void copy_out(uint64_t position, char* data, size_t n) const noexcept
+            {
+                const size_t offset = position & (rx.size - 1);
+                const size_t first = std::min(n, rx.size - offset);
+                std::memcpy(data, rx.data + offset, first);
+                std::memcpy(data + first, rx.data, n - first);
+            }
+
+            // The store before it (position) and the load of the futex word
+            // pair up with park()'s store of the word and re-check, so either
+            // the sleeper sees the new position or the waker sees the sleeper.
+            static void wake(std::atomic<uint32_t>& parked) noexcept
+            {
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                if (parked.load(std::memory_order_relaxed) == 0)
+                    return;
+
+                parked.store(0, std::memory_order_relaxed);
+                ::syscall(SYS_futex, reinterpret_cast<uint32_t*>(&parked), FUTEX_WAKE, 1, nullptr, nullptr, 0);
+            }
+
+            // false once the peer's socket is gone without it ever waking us
+            template <typename Ready>
+            static bool park(native_socket_type fd, std::atomic<uint32_t>& parked, Ready&& ready) noexcept
+            {
+                while (true) {
+                    parked.store(1, std::memory_order_seq_cst);
+                    if (ready())
+                        break;
+
+                    const timespec timeout{ 0, peer_check_ms * 1000000L };
+                    const long rc = ::syscall(SYS_futex, reinterpret_cast<uint32_t*>(&parked), FUTEX_WAIT, 1, &timeout, nullptr, 0);
+                    if (ready())
+                        break;
+
+                    char byte;
+                    if (rc == -1 && errno == ETIMEDOUT && ::recv(fd, &byte, 1, MSG_PEEK | MSG_DONTWAIT) == 0) {
+                        parked.store(0, std::memory_order_relaxed);
+                        return false;
+                    }
+                }
+
+                parked.store(0, std::memory_order_relaxed);
+                return true;
+            }
+
+            static bool send_hello(native_socket_type fd, int memfd, size_t ring_size) noexcept
+            {
+                shm_hello hello{ shm_hello::expected_magic, 0, ring_size };
+                iovec iov{ &hello, sizeof(hello) };
+
+                alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))] = {};
+                msghdr message{};
+                message.msg_iov = &iov;
+                message.msg_iovlen = 1;
+                message.msg_control = control;
+                message.msg_controllen = sizeof(control);
+
+                cmsghdr* cmsg = CMSG_FIRSTHDR(&message);
+                cmsg->cmsg_level = SOL_SOCKET;
+                cmsg->cmsg_type = SCM_RIGHTS;
+                cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+                std::memcpy(CMSG_DATA(cmsg), &memfd, sizeof(int));
+
+                return ::sendmsg(fd, &message, MSG_NOSIGNAL) == sizeof(hello);
+            }
+
+            // the memfd, or -1
+            static int receive_hello(native_socket_type fd, shm_hello& hello) noexcept
+            {
+                iovec iov{ &hello, sizeof(hello) };
+
+                alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))] = {};
+                msghdr message{};
+                message.msg_iov = &iov;
+                message.msg_iovlen = 1;
+                message.msg_control = control;
+                message.msg_controllen = sizeof(control);
+
+                if (::recvmsg(fd, &message, MSG_WAITALL | MSG_CMSG_CLOEXEC) != sizeof(hello))
+                    return -1;
+
+                const cmsghdr* cmsg = CMSG_FIRSTHDR(&message);
+                if (cmsg == nullptr || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+                    return -1;
+
+                int memfd;
+                std::memcpy(&memfd, CMSG_DATA(cmsg), sizeof(int));
+                return memfd;
+            }
+
+            void* mapping = nullptr;
+            size_t mapping_size = 0;
+            ring_view tx;
+            ring_view rx;
+    };
+}
+
+namespace unet
+{
+    using shm_socket = basic_socket<socktype_shm, detail::local_socket_storage>;
+}
+
+#endif
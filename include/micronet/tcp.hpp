@@ -13,6 +13,12 @@ namespace unet
     };
 
     using tcp_socket = basic_socket<socktype_tcp>;
+    using tcp_connection = basic_connection<socktype_tcp>;
+
+    // per-connection footprint: the fd, timestamp id counter and mtu, see README
+    static_assert(sizeof(tcp_connection) <= sizeof(os_socket_type) + 8, "tcp_connection grew");
+    static_assert(std::is_same_v<decltype(tcp_socket::mtu_size), decltype(tcp_connection::mtu_size)>,
+        "both layouts take the same mtu_size");
 }
 
 #endif
@@ -0,0 +1,399 @@
+#ifndef UNET_SOCKETS_TLS_HPP
+#define UNET_SOCKETS_TLS_HPP
+
+// TLS for `secure = true` socket types, backed by OpenSSL; link with
+// -lssl -lcrypto.
+//
+// Contexts enable SSL_OP_ENABLE_KTLS, so after the handshake OpenSSL moves
+// the record layer into the kernel (TCP_ULP "tls") when the kernel and the
+// negotiated cipher allow it.  SSL_read/SSL_write then become plain
+// recv/send on the socket and send_file() goes through SSL_sendfile
+// without a user-space copy.  Otherwise OpenSSL encrypts in user space.
+
+#if !defined(__linux__) && !defined(__linux)
+# error tls.hpp is POSIX only
+#endif
+
+#include "basic_socket.hpp"
+
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+#include <openssl/bio.h>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+
+namespace unet::detail
+{
+    // SSL_CTX ex_data slot holding the handshake timeout in milliseconds
+    inline int tls_handshake_timeout_index() noexcept
+    {
+        static const int index = SSL_CTX_get_ex_new_index(0, nullptr, nullptr, nullptr, nullptr);
+        return index;
+    }
+
+    constexpr std::chrono::milliseconds default_tls_handshake_timeout{10'000};
+}
+
+namespace unet
+{
+    struct tls_client_opts
+    {
+        bool verify_peer = true;    // chain and host name
+        std::string ca_file;        // empty for the system trust store
+    };
+
+    // Shared, reference counted SSL_CTX.  Sockets keep their own reference,
+    // so a context may go out of scope while they still use it.
+    class tls_context
+    {
+        public:
+            tls_context() noexcept = default;
+            tls_context(const tls_context& other) noexcept : ctx(other.ctx) { if (ctx) SSL_CTX_up_ref(ctx); }
+            tls_context(tls_context&& other) noexcept : ctx(std::exchange(other.ctx, nullptr)) {}
+            tls_context& operator=(tls_context other) noexcept { std::swap(ctx, other.ctx); return *this; }
+            ~tls_context() { SSL_CTX_free(ctx); }
+
+            static tl::expected<tls_context, error_code> client(const tls_client_opts& opts = {}) noexcept
+            {
+                tls_context rval(SSL_CTX_new(TLS_client_method()));
+                if (not rval.ctx)
+                    return tl::unexpected(error_code::tls_setup_failed);
+
+                if (opts.verify_peer) {
+                    const int loaded = opts.ca_file.empty() ? SSL_CTX_set_default_verify_paths(rval.ctx)
+                                                            : SSL_CTX_load_verify_locations(rval.ctx, opts.ca_file.c_str(), nullptr);
+                    if (loaded != 1)
+                        return tl::unexpected(error_code::tls_setup_failed);
+                    SSL_CTX_set_verify(rval.ctx, SSL_VERIFY_PEER, nullptr);
+                }
+                return rval;
+            }
+
+            static tl::expected<tls_context, error_code> server(const std::string& cert_chain_file, const std::string& key_file) noexcept
+            {
+                tls_context rval(SSL_CTX_new(TLS_server_method()));
+                if (not rval.ctx
+                    || SSL_CTX_use_certificate_chain_file(rval.ctx, cert_chain_file.c_str()) != 1
+                    || SSL_CTX_use_PrivateKey_file(rval.ctx, key_file.c_str(), SSL_FILETYPE_PEM) != 1
+                    || SSL_CTX_check_private_key(rval.ctx) != 1)
+                    return tl::unexpected(error_code::tls_setup_failed);
+                return rval;
+            }
+
+            // takes over a context configured by hand
+            static tls_context adopt(SSL_CTX* native) noexcept { return tls_context(native); }
+
+            // how long connect() and accept() wait for the peer's side of the
+            // handshake before failing with error_code::tls_handshake_failed,
+            // 10s unless set; a server's accept() is held up by a silent client
+            // for at most this long.  Applies to every socket using the context.
+            void handshake_timeout(std::chrono::milliseconds timeout) noexcept
+            {
+                if (ctx)
+                    SSL_CTX_set_ex_data(ctx, detail::tls_handshake_timeout_index(), reinterpret_cast<void*>(static_cast<intptr_t>(timeout.count())));
+            }
+
+            std::chrono::milliseconds handshake_timeout() const noexcept
+            {
+                const auto ms = ctx ? reinterpret_cast<intptr_t>(SSL_CTX_get_ex_data(ctx, detail::tls_handshake_timeout_index())) : 0;
+                return ms > 0 ? std::chrono::milliseconds(ms) : detail::default_tls_handshake_timeout;
+            }
+
+            SSL_CTX* native_handle() const noexcept { return ctx; }
+            explicit operator bool() const noexcept { return ctx != nullptr; }
+
+        private:
+            explicit tls_context(SSL_CTX* native) noexcept : ctx(native)
+            {
+                if (not ctx)
+                    return;
+
+                SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
+                #if defined(SSL_OP_ENABLE_KTLS)
+                SSL_CTX_set_options(ctx, SSL_OP_ENABLE_KTLS);
+                #endif
+                SSL_CTX_set_mode(ctx, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+            }
+
+            SSL_CTX* ctx = nullptr;
+    };
+
+    struct tls_status
+    {
+        bool ktls_send = false;     // records are encrypted by the kernel
+        bool ktls_recv = false;
+        std::string_view version;   // "TLSv1.3"
+        std::string_view cipher;
+    };
+
+    struct socktype_tls
+    {
+        constexpr static int    domain          = PF_INET;
+        constexpr static int    type            = SOCK_STREAM;
+        constexpr static bool   secure          = true;
+    };
+
+    using tls_socket = basic_socket<socktype_tls>;
+    using tls_connection = basic_connection<socktype_tls>;
+}
+
+namespace unet::detail
+{
+    // used by connect() when no context was set
+    inline SSL_CTX* default_tls_client_context() noexcept
+    {
+        static tls_context context = tls_context::client().value_or(tls_context{});
+        return context.native_handle();
+    }
+
+    // Blocks SIGPIPE on this thread while OpenSSL writes on its own, in the
+    // handshake (session tickets) and on close (close_notify), where a peer
+    // that already went away would otherwise kill the process.
+    class sigpipe_guard
+    {
+        public:
+            sigpipe_guard() noexcept
+            {
+                sigemptyset(&pipe);
+                sigaddset(&pipe, SIGPIPE);
+
+                sigset_t pending;
+                sigpending(&pending);
+                was_pending = sigismember(&pending, SIGPIPE);
+                pthread_sigmask(SIG_BLOCK, &pipe, &previous);
+            }
+
+            ~sigpipe_guard()
+            {
+                // swallow the one we caused, if any
+                sigset_t pending;
+                sigpending(&pending);
+                if (not was_pending && sigismember(&pending, SIGPIPE)) {
+                    const timespec no_wait{ 0, 0 };
+                    sigtimedwait(&pipe, nullptr, &no_wait);
+                }
+                pthread_sigmask(SIG_SETMASK, &previous, nullptr);
+            }
+
+        private:
+            sigset_t pipe;
+            sigset_t previous;
+            bool was_pending;
+    };
+
+    template <>
+    class tls_state<true>
+    {
+        public:
+            tls_state() noexcept = default;
+            tls_state(tls_state&& other) noexcept { *this = std::move(other); }
+            tls_state& operator=(tls_state&& other) noexcept
+            {
+                std::swap(ssl, other.ssl);
+                std::swap(context, other.context);
+                std::swap(fatal, other.fatal);
+                return *this;
+            }
+            ~tls_state() { reset(); }
+
+            void use_context(SSL_CTX* ctx) noexcept
+            {
+                SSL_CTX_up_ref(ctx);
+                SSL_CTX_free(context);
+                context = ctx;
+            }
+
+            // bounded by the context's handshake timeout and, when given, `limit`
+            tl::expected<void, error_code> handshake(native_socket_type fd, bool server, const std::string& host,
+                                                     std::chrono::milliseconds limit = std::chrono::milliseconds(0)) noexcept
+            {
+                SSL_CTX* ctx = context ? context : server ? nullptr : default_tls_client_context();
+                if (ctx == nullptr)
+                    return tl::unexpected(error_code::tls_setup_failed);
+
+                const intptr_t configured = reinterpret_cast<intptr_t>(SSL_CTX_get_ex_data(ctx, tls_handshake_timeout_index()));
+                std::chrono::milliseconds timeout = configured > 0 ? std::chrono::milliseconds(configured) : default_tls_handshake_timeout;
+                if (limit.count() > 0)
+                    timeout = std::min(timeout, limit);
+                const auto deadline = receive_clock::now() + timeout;
+
+                ssl = SSL_new(ctx);
+                if (ssl == nullptr || SSL_set_fd(ssl, fd) != 1)
+                    return fail_handshake();
+
+                if (not server && not host.empty()) {
+                    SSL_set_tlsext_host_name(ssl, host.c_str());
+                    if (SSL_CTX_get_verify_mode(ctx) & SSL_VERIFY_PEER)
+                        SSL_set1_host(ssl, host.c_str());
+                }
+
+                // readiness is waited for in wait(), so MSG_DONTWAIT maps onto WANT_READ
+                ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+                sigpipe_guard guard;
+                while (true) {
+                    const int rc = server ? SSL_accept(ssl) : SSL_connect(ssl);
+                    if (rc == 1)
+                        return {};
+                    if (not wait(fd, SSL_get_error(ssl, rc), deadline))
+                        return fail_handshake();
+                }
+            }
+
+            ssize_t read(native_socket_type fd, void* data, size_t size, int flags) noexcept
+            {
+                while (true) {
+                    size_t n = 0;
+                    errno = 0;
+                    const int rc = flags & MSG_PEEK ? SSL_peek_ex(ssl, data, size, &n) : SSL_read_ex(ssl, data, size, &n);
+                    if (rc == 1)
+                        return n;
+
+                    const int err = SSL_get_error(ssl, rc);
+                    if (err == SSL_ERROR_ZERO_RETURN)
+                        return 0;
+                    if (err == SSL_ERROR_SYSCALL && errno == 0) {
+                        // closed without close_notify
+                        fatal = true;
+                        return 0;
+                    }
+                    if (not retry(fd, err, flags))
+                        return -1;
+                }
+            }
+
+            ssize_t write(native_socket_type fd, const void* data, size_t size, int flags) noexcept
+            {
+                while (true) {
+                    size_t n = 0;
+                    const int rc = SSL_write_ex(ssl, data, size, &n);
+                    if (rc == 1)
+                        return n;
+                    if (not retry(fd, SSL_get_error(ssl, rc), flags))
+                        return -1;
+                }
+            }
+
+            // straight from the page cache, only with kTLS send
+            ssize_t sendfile(native_socket_type fd, int file_fd, off_t offset, size_t size) noexcept
+            {
+                #if !defined(OPENSSL_NO_KTLS)
+                while (true) {
+                    const ossl_ssize_t n = SSL_sendfile(ssl, file_fd, offset, size, 0);
+                    if (n >= 0)
+                        return n;
+                    if (not retry(fd, SSL_get_error(ssl, static_cast<int>(n)), 0))
+                        return -1;
+                }
+                #else
+                (void)fd, (void)file_fd, (void)offset, (void)size;
+                errno = ENOSYS;
+                return -1;
+                #endif
+            }
+
+            bool ktls_send() const noexcept { return ssl && BIO_get_ktls_send(SSL_get_wbio(ssl)); }
+            bool ktls_recv() const noexcept { return ssl && BIO_get_ktls_recv(SSL_get_rbio(ssl)); }
+
+            tls_status status() const noexcept
+            {
+                if (ssl == nullptr)
+                    return {};
+                return { ktls_send(), ktls_recv(), SSL_get_version(ssl), SSL_get_cipher_name(ssl) };
+            }
+
+            SSL_CTX* listening_context() const noexcept { return context; }
+
+            // sends close_notify without waiting for the reply, before the fd goes
+            void shutdown() noexcept
+            {
+                if (ssl && not fatal && SSL_is_init_finished(ssl)) {
+                    sigpipe_guard guard;
+                    SSL_shutdown(ssl);
+                }
+                SSL_free(std::exchange(ssl, nullptr));
+                fatal = false;
+            }
+
+        private:
+            void reset() noexcept
+            {
+                shutdown();
+                SSL_CTX_free(std::exchange(context, nullptr));
+            }
+
+            tl::expected<void, error_code> fail_handshake() noexcept
+            {
+                ERR_clear_error();
+                SSL_free(std::exchange(ssl, nullptr));
+                return tl::unexpected(error_code::tls_handshake_failed);
+            }
+
+            // for SSL_ERROR_WANT_*, false with errno set for anything else
+            bool retry(native_socket_type fd, int err, int flags) noexcept
+            {
+                const bool wants_io = err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE;
+                if (wants_io && (flags & MSG_DONTWAIT)) {
+                    errno = EAGAIN;
+                    return false;
+                }
+                if (wants_io)
+                    return wait(fd, err);
+
+                if (err == SSL_ERROR_SSL) {
+                    fatal = true;
+                    errno = EPROTO;
+                }
+                ERR_clear_error();
+                return false;
+            }
+
+            // false once `deadline` passes
+            static bool wait(native_socket_type fd, int err, receive_clock::time_point deadline = no_deadline) noexcept
+            {
+                if (err != SSL_ERROR_WANT_READ && err != SSL_ERROR_WANT_WRITE)
+                    return false;
+
+                int timeout = -1;
+                if (deadline != no_deadline) {
+                    timeout = static_cast<int>(time_left(deadline).count());
+                    if (timeout == 0)
+                        return false;
+                }
+
+                pollfd pfd{ fd, static_cast<short>(err == SSL_ERROR_WANT_READ ? POLLIN : POLLOUT), 0 };
+                return ::poll(&pfd, 1, timeout) > 0;
+            }
+
+            SSL* ssl = nullptr;
+            SSL_CTX* context = nullptr;     // for connect() and, on listeners, accepted sockets
+            bool fatal = false;
+    };
+}
+
+namespace unet
+{
+    template <suitable_socket_type SockType, typename Storage>
+    void basic_socket<SockType, Storage>::use_tls(const tls_context& context) noexcept requires is_secure
+    {
+        tls.use_context(context.native_handle());
+    }
+
+    template <suitable_socket_type SockType, typename Storage>
+    tls_status basic_socket<SockType, Storage>::tls_info() const noexcept requires is_secure
+    {
+        return tls.status();
+    }
+}
+
+#endif
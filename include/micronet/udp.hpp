@@ -13,6 +13,12 @@ namespace unet
     };
 
     using udp_socket = basic_socket<socktype_udp>;
+    using udp_connection = basic_connection<socktype_udp>;
+
+    // per-connection footprint: the fd, timestamp id counter and mtu, see README
+    static_assert(sizeof(udp_connection) <= sizeof(os_socket_type) + 8, "udp_connection grew");
+    static_assert(std::is_same_v<decltype(udp_socket::mtu_size), decltype(udp_connection::mtu_size)>,
+        "both layouts take the same mtu_size");
 }
 
 #endif